@@ -0,0 +1,357 @@
+// Microbenchmarks, part of spectrum.
+//
+// Times the DSP and raster kernels on their own over representative
+// sizes: FFTs of 2048 to 32768 points, 30 to 800 bars, the 800x480
+// panel and a 1920x1080 screen, blitted to a headless framebuffer at
+// 32 and 16 bpp. Each case is run in batches long enough for the clock,
+// and the ns per call over the batches is reported with its spread, as
+// a table on stdout and as CSV rows, one per case, tagged with the
+// machine and version so files from different builds and boards can
+// simply be concatenated.
+//
+//   bench [-o bench.csv] [-f font.ttf] [-r runs]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#include <fftw3.h>
+
+#include "sigproc.h"
+#include "output/fbplot.h"
+
+#define RUNS 11                 // timed batches per case, by default
+#define BATCH_NS 5e6            // at least this long per batch
+#define RATE 44100
+
+// what a kernel works on; each uses the fields it needs
+typedef struct {
+    struct audio_data *audio;
+    buffer b, b2;
+    axes ax;
+    int *bins;
+    int n;
+    const char *text;
+} job;
+
+typedef void (*kernel)(job *j);
+
+static int runs = RUNS;
+static FILE *csv;
+static char machine[128];
+static volatile double sink;
+
+static double now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static double batch(kernel k, job *j, long reps) {
+    double t0 = now_ns();
+    for (long i = 0; i < reps; i++) {
+        k(j);
+    }
+    return now_ns() - t0;
+}
+
+static int by_value(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void measure(const char *name, const char *size, double items, const char *unit, kernel k, job *j) {
+    // Batches of reps calls, reps doubled until a batch is long enough
+    // to time; the first also warms the caches.
+    long reps = 1;
+    while (batch(k, j, reps) < BATCH_NS && reps < (1L << 30)) {
+        reps *= 2;
+    }
+    double *ns = malloc(sizeof(double) * runs);
+    double mean = 0, var = 0;
+    for (int r = 0; r < runs; r++) {
+        ns[r] = batch(k, j, reps) / reps;
+        mean += ns[r];
+    }
+    mean /= runs;
+    for (int r = 0; r < runs; r++) {
+        var += (ns[r] - mean) * (ns[r] - mean);
+    }
+    double sd = runs > 1 ? sqrt(var / (runs - 1)) : 0;
+    qsort(ns, runs, sizeof(double), by_value);
+    double median = ns[runs / 2], fastest = ns[0];
+    double rate = items / median * 1e9;
+
+    printf("%-13s %-11s %12.1f ns %6.1f%% %12.4g %s/s\n",
+            name, size, median, 100 * sd / mean, rate, unit);
+    fprintf(csv, "\"%s\",\"%s\",%s,%s,%ld,%d,%.1f,%.1f,%.1f,%.1f,%.6g,%s\n",
+            machine, VERSION, name, size, reps, runs, median, mean, sd, fastest, rate, unit);
+    fflush(csv);
+    free(ns);
+}
+
+/* the kernels */
+
+static void run_window(job *j) {
+    window(j->audio, HANN);
+}
+
+static void run_make_bins(job *j) {
+    sink += make_bins(j->audio, j->n, LEFT_CHANNEL)[0];
+}
+
+static void run_monstercat(job *j) {
+    monstercat(j->bins, j->n, 5);
+}
+
+static void run_ppm_level(job *j) {
+    double l, r;
+    ppm_level(j->audio, j->n, &l, &r);
+    sink += l + r;
+}
+
+static void run_plot_bars(job *j) {
+    bf_plot_bars(j->b, j->ax, j->bins, j->n, (rgba){0xff, 0x40, 0x20, 0});
+}
+
+static void run_text(job *j) {
+    bf_text(j->b, (char *)j->text, strlen(j->text), j->n, 0, 20, j->b.h / 2, 0, (rgba){0xff, 0xff, 0xff, 0});
+}
+
+static void run_blend(job *j) {
+    bf_blend(j->b, j->b2, 0.9);
+}
+
+static void run_draw_arc(job *j) {
+    bf_draw_arc(j->b, j->b.w / 2, j->b.h / 4, j->n, 30, 150, 3, (rgba){0xc1, 0xbd, 0xb2, 0});
+}
+
+static void run_blit(job *j) {
+    bf_blit(j->b);
+}
+
+/* the cases */
+
+static struct audio_data *audio_new(int size) {
+    // a second of three tones in noise, windowed and transformed so
+    // that make_bins sees a real spectrum
+    struct audio_data *a = calloc(1, sizeof(*a));
+    int n = 2 * (size / 2 + 1);
+    a->FFTbufferSize = size;
+    a->rate = RATE;
+    a->in_l = fftw_alloc_real(n);
+    a->in_r = fftw_alloc_real(n);
+    a->windowed_l = fftw_alloc_real(n);
+    a->windowed_r = fftw_alloc_real(n);
+    a->out_l = fftw_alloc_complex(n);
+    a->out_r = fftw_alloc_complex(n);
+    srand(1);
+    for (int i = 0; i < n; i++) {
+        double t = (double)i / RATE;
+        double s = 8000 * sin(2 * M_PI * 100 * t) + 4000 * sin(2 * M_PI * 1000 * t) +
+            2000 * sin(2 * M_PI * 10000 * t) + 1000.0 * rand() / RAND_MAX - 500;
+        a->in_l[i] = s;
+        a->in_r[i] = -s;
+    }
+    window(a, HANN);
+    fftw_plan plan = fftw_plan_dft_r2c_1d(size, a->windowed_l, a->out_l, FFTW_ESTIMATE);
+    fftw_execute(plan);
+    fftw_destroy_plan(plan);
+    return a;
+}
+
+static void audio_free(struct audio_data *a) {
+    fftw_free(a->in_l);
+    fftw_free(a->in_r);
+    fftw_free(a->windowed_l);
+    fftw_free(a->windowed_r);
+    fftw_free(a->out_l);
+    fftw_free(a->out_r);
+    free(a);
+}
+
+static void bench_dsp(void) {
+    static const int sizes[] = {2048, 4096, 8192, 16384, 32768};
+    static const int bars[] = {30, 100, 400, 800};
+    static const int rates[] = {44100, 96000, 192000};
+    char size[32];
+    job j;
+    memset(&j, 0, sizeof(j));
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        j.audio = audio_new(sizes[s]);
+        snprintf(size, sizeof(size), "%d", sizes[s]);
+        measure("window", size, sizes[s], "samples", run_window, &j);
+        // make_bins needs a bin below 20 Hz, which 2048 points lack
+        for (size_t b = 0; sizes[s] * LOWER_CUTOFF_FREQ >= RATE && b < sizeof(bars) / sizeof(bars[0]); b++) {
+            j.n = bars[b];
+            snprintf(size, sizeof(size), "%dx%d", sizes[s], bars[b]);
+            measure("make_bins", size, sizes[s] / 2, "bins", run_make_bins, &j);
+        }
+        audio_free(j.audio);
+    }
+
+    j.bins = malloc(sizeof(int) * 800);
+    for (size_t b = 0; b < sizeof(bars) / sizeof(bars[0]); b++) {
+        for (int i = 0; i < bars[b]; i++) {
+            j.bins[i] = rand() % 100;
+        }
+        j.n = bars[b];
+        snprintf(size, sizeof(size), "%d", bars[b]);
+        measure("monstercat", size, bars[b], "bars", run_monstercat, &j);
+    }
+    free(j.bins);
+
+    // the 5 ms the meters average over
+    j.audio = audio_new(8192);
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        j.audio->rate = rates[r];
+        j.n = 5 * rates[r] / 1000;
+        snprintf(size, sizeof(size), "%d", rates[r]);
+        measure("ppm_level", size, j.n, "samples", run_ppm_level, &j);
+    }
+    audio_free(j.audio);
+}
+
+static void bench_text(job *j, const char *font) {
+    static const int sizes[] = {8, 16, 64};
+    char size[32];
+    j->text = "-12.3dB 44.1kHz";
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        j->n = sizes[s];
+        snprintf(size, sizeof(size), "%d", sizes[s]);
+        measure("bf_text", size, strlen(j->text), "glyphs", run_text, j);
+    }
+    if (!freetype_sdf(font, font, "")) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            j->n = sizes[s];
+            snprintf(size, sizeof(size), "%d", sizes[s]);
+            measure("bf_text_sdf", size, strlen(j->text), "glyphs", run_text, j);
+        }
+    }
+    // back to drawing glyphs for the next screen
+    freetype_cleanup();
+    freetype_init((char *)font, (char *)font);
+}
+
+static int bench_screen(uint32_t w, uint32_t h, int bpp, const char *font) {
+    // the raster kernels on a screen of w x h, or just the blit at
+    // depths other than 32
+    static const int bars[] = {30, 100, 400, 800};
+    static const int radii[] = {100, 200};
+    fb_options o = {.headless = 1, .width = w, .height = h, .bpp = bpp, .dither = 1, .dump = FB_DUMP_NONE, .dump_path = ""};
+    char size[32];
+    job j;
+    memset(&j, 0, sizeof(j));
+    if (fb_setup(&o)) {
+        fprintf(stderr, "bench: could not open a headless %ux%u screen\n", w, h);
+        return -1;
+    }
+    bf_init(&j.b);
+    bf_init(&j.b2);
+    if (!j.b.pixels || !j.b2.pixels) {
+        fprintf(stderr, "bench: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    bf_fill(j.b, (rgba){0x20, 0x30, 0x40, 0});
+    bf_fill(j.b2, (rgba){0x80, 0x70, 0x60, 0});
+
+    double pixels = (double)w * h;
+    snprintf(size, sizeof(size), "%ux%ux%d", w, h, bpp);
+    measure("fb_blit", size, pixels, "pixels", run_blit, &j);
+    if (bpp == 32) {
+        snprintf(size, sizeof(size), "%ux%u", w, h);
+        measure("bf_blend", size, pixels, "pixels", run_blend, &j);
+
+        j.ax = (axes){.screen_x = 10, .screen_y = 10, .screen_w = w - 20, .screen_h = h - 20,
+            .base = 10, .x_min = 0, .x_max = 1, .y_min = 0, .y_max = 100};
+        j.bins = malloc(sizeof(int) * 800);
+        for (size_t b = 0; b < sizeof(bars) / sizeof(bars[0]); b++) {
+            for (int i = 0; i < bars[b]; i++) {
+                j.bins[i] = rand() % 100;
+            }
+            j.n = bars[b];
+            snprintf(size, sizeof(size), "%ux%ux%d", w, h, bars[b]);
+            measure("bf_plot_bars", size, bars[b], "bars", run_plot_bars, &j);
+        }
+        free(j.bins);
+
+        for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+            j.n = radii[r] * (int)h / 480;
+            snprintf(size, sizeof(size), "%ux%ux%d", w, h, j.n);
+            measure("bf_draw_arc", size, 1, "arcs", run_draw_arc, &j);
+        }
+
+        if (w == 800) {
+            bench_text(&j, font);
+        }
+    }
+
+    bf_free_pixels(&j.b);
+    bf_free_pixels(&j.b2);
+    fb_cleanup();
+    return 0;
+}
+
+static void machine_name(void) {
+    // the board where the device tree names it, else the architecture
+    FILE *f = fopen("/proc/device-tree/model", "r");
+    size_t n = f ? fread(machine, 1, sizeof(machine) - 1, f) : 0;
+    machine[n] = '\0';
+    if (f) {
+        fclose(f);
+    }
+    if (!machine[0]) {
+        struct utsname u;
+        snprintf(machine, sizeof(machine), "%s", uname(&u) ? "unknown" : u.machine);
+    }
+    for (char *c = machine; *c; c++) {
+        *c = *c == '"' ? '\'' : *c;
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *out = "bench.csv";
+    const char *font = "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf";
+    int c;
+    while ((c = getopt(argc, argv, "o:f:r:h")) != -1) {
+        switch (c) {
+        case 'o':
+            out = optarg;
+            break;
+        case 'f':
+            font = optarg;
+            break;
+        case 'r':
+            runs = atoi(optarg) > 0 ? atoi(optarg) : RUNS;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-o bench.csv] [-f font.ttf] [-r runs]\n", argv[0]);
+            return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    csv = fopen(out, "w");
+    if (!csv) {
+        fprintf(stderr, "bench: could not write %s\n", out);
+        return EXIT_FAILURE;
+    }
+    machine_name();
+    fprintf(csv, "machine,version,kernel,size,reps,runs,ns_median,ns_mean,ns_stddev,ns_min,throughput,unit\n");
+    printf("%-13s %-11s %15s %7s %12s\n", "kernel", "size", "median", "spread", "throughput");
+
+    bench_dsp();
+    freetype_init((char *)font, (char *)font);
+    bench_screen(800, 480, 32, font);
+    bench_screen(1920, 1080, 32, font);
+    bench_screen(800, 480, 16, font);
+    freetype_cleanup();
+
+    fclose(csv);
+    printf("results in %s\n", out);
+    return EXIT_SUCCESS;
+}
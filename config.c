@@ -28,6 +28,24 @@ const bool has_input_method[] = {
     HAS_ALSA, HAS_PULSE, HAS_SNDIO, true,
 };
 
+const char *output_method_names[] = {
+    "fbdev", "headless",
+};
+
+const char *dump_names[] = {
+    "none", "raw", "ppm", "checksum",
+};
+
+static int index_by_name(const char *str, const char **names, int n) {
+    for (int i = 0; i < n; i++) {
+        if (!strcmp(str, names[i])) {
+            return i;
+        }
+    }
+
+    return n;
+}
+
 enum input_method input_method_by_name(const char *str) {
     for (int i = 0; i < INPUT_MAX; i++) {
         if (!strcmp(str, input_method_names[i])) {
@@ -94,6 +112,48 @@ bool validate_config(struct config_params *p, struct error_s *error) {
         return false;
     }
 
+    // validate: frame rate
+    if (p->fps < 1 || p->fps > 1000) {
+        write_errorf(error, "fps must be between 1 and 1000\n");
+        return false;
+    }
+
+    // validate: needles
+    if (p->needle_step < 0 || p->needle_step > 45) {
+        write_errorf(error, "needle_step must be between 0 and 45 degrees\n");
+        return false;
+    }
+
+    // validate: oscilloscope
+    if (p->scope_ms < 1 || p->scope_ms > 1000) {
+        write_errorf(error, "scope_ms must be between 1 and 1000\n");
+        return false;
+    }
+
+    // validate: output
+    if (p->om == OUTPUT_MAX) {
+        write_errorf(error, "output method must be 'fbdev' or 'headless'\n");
+        return false;
+    }
+    if (p->dump == (int)ARRAY_SIZE(dump_names)) {
+        write_errorf(error, "output dump must be 'none', 'raw', 'ppm' or 'checksum'\n");
+        return false;
+    }
+    if (p->om == OUTPUT_HEADLESS && (p->fb_width <= 0 || p->fb_height <= 0)) {
+        write_errorf(error, "headless output needs a width and height\n");
+        return false;
+    }
+
+    // validate: framebuffer depth
+    if (p->fb_bpp != 0 && p->fb_bpp != 16 && p->fb_bpp != 24 && p->fb_bpp != 32) {
+        write_errorf(error, "output bpp must be 16, 24 or 32 (or 0 to keep the current depth)\n");
+        return false;
+    }
+    if (p->rotate % 90 != 0 || p->rotate < 0 || p->rotate > 270) {
+        write_errorf(error, "output rotate must be 0, 90, 180 or 270\n");
+        return false;
+    }
+
     // validate: alpha
     if (p->alpha < 0) {
         p->alpha = 0;
@@ -185,6 +245,16 @@ bool load_config(char configPath[PATH_MAX], struct config_params *p, struct erro
     }
 
     p->noise_floor = iniparser_getint(ini, "general:noise_floor", -100);
+    p->antialias = iniparser_getboolean(ini, "general:antialias", 1);
+    p->fps = iniparser_getdouble(ini, "general:fps", 60);
+    p->render_threads = iniparser_getint(ini, "general:render_threads", 0);
+    p->idle_blank = iniparser_getint(ini, "general:idle_blank", 0);
+    p->overlay = iniparser_getboolean(ini, "general:overlay", 0);
+    p->perf_counters = iniparser_getboolean(ini, "general:perf_counters", 0);
+    free(p->metrics_socket);
+    p->metrics_socket = strdup(iniparser_getstring(ini, "general:metrics_socket", ""));
+    free(p->trace_file);
+    p->trace_file = strdup(iniparser_getstring(ini, "general:trace_file", "/tmp/spectrum-trace.json"));
     
     free(p->text_font);
     p->text_font = strdup(iniparser_getstring(ini, "general:text_font", "/usr/share/fonts/truetype/dejavu/DejaVuSerif.ttf"));
@@ -192,10 +262,42 @@ bool load_config(char configPath[PATH_MAX], struct config_params *p, struct erro
     free(p->audio_font);
     p->audio_font = strdup(iniparser_getstring(ini, "general:audio_font", "/usr/share/fonts/truetype/dejavu/DejaVuSerif.ttf"));
 
+    p->sdf_text = iniparser_getboolean(ini, "general:sdf_text", 0);
+    free(p->sdf_cache);
+    p->sdf_cache = strdup(iniparser_getstring(ini, "general:sdf_cache", ""));
+
     free(p->vis);
     p->vis = strdup(iniparser_getstring(ini, "general:vis", "fft"));
 
+    p->needle_step = iniparser_getdouble(ini, "general:needle_step", 0.25);
+    free(p->needle_image);
+    p->needle_image = strdup(iniparser_getstring(ini, "general:needle_image", ""));
+    p->needle_pivot_x = iniparser_getdouble(ini, "general:needle_pivot_x", -1);
+    p->needle_pivot_y = iniparser_getdouble(ini, "general:needle_pivot_y", -1);
+    p->scope_ms = iniparser_getdouble(ini, "general:scope_ms", 20);
+    free(p->skin);
+    p->skin = strdup(iniparser_getstring(ini, "general:skin", ""));
+
     // config: output
+    p->om = index_by_name(iniparser_getstring(ini, "output:method", "fbdev"),
+            output_method_names, OUTPUT_MAX);
+    free(p->fb_device);
+    p->fb_device = strdup(iniparser_getstring(ini, "output:device", "/dev/fb0"));
+    p->fb_width = iniparser_getint(ini, "output:width", 800);
+    p->fb_height = iniparser_getint(ini, "output:height", 480);
+    p->dump = index_by_name(iniparser_getstring(ini, "output:dump", "none"),
+            dump_names, ARRAY_SIZE(dump_names));
+    free(p->dump_path);
+    p->dump_path = strdup(iniparser_getstring(ini, "output:dump_path", ""));
+    p->fb_bpp = iniparser_getint(ini, "output:bpp", 0);
+    p->dither = iniparser_getboolean(ini, "output:dither", 1);
+    p->rotate = iniparser_getint(ini, "output:rotate", 0);
+    p->flip_x = iniparser_getboolean(ini, "output:flip_x", 0);
+    p->flip_y = iniparser_getboolean(ini, "output:flip_y", 0);
+    free(p->backlight);
+    p->backlight = strdup(iniparser_getstring(ini, "output:backlight", ""));
+    p->brightness = iniparser_getint(ini, "output:brightness", -1);
+
     free(p->audio_source);
 
     // config: input
@@ -36,13 +36,25 @@ enum input_method {
     INPUT_MAX
 };
 
+enum output_method {
+    OUTPUT_FBDEV,
+    OUTPUT_HEADLESS,
+    OUTPUT_MAX
+};
+
 struct config_params {
     char *plot_l_col, *plot_r_col, *ax_col, *ax_2_col, *text_col, *audio_col;
     char *audio_source, *text_font, *audio_font, *vis;
-    double alpha, noise_floor;
+    char *fb_device, *dump_path, *needle_image, *skin, *backlight, *sdf_cache, *metrics_socket, *trace_file;
+    double alpha, noise_floor, fps;
+    double needle_step, needle_pivot_x, needle_pivot_y, scope_ms;
     double *userEQ;
     enum input_method im;
+    enum output_method om;
     int col, bgcol, fifoSample, fifoSampleBits;
+    int antialias, render_threads, idle_blank, sdf_text, overlay, perf_counters;
+    int fb_width, fb_height, fb_bpp, dither, dump;
+    int rotate, flip_x, flip_y, brightness;
 };
 
 struct error_s {
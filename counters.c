@@ -0,0 +1,127 @@
+// syscall() is not declared for strict POSIX
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "counters.h"
+
+static const char *names[COUNTER_MAX] = {
+    "cycles", "instructions", "cache-misses", "branch-misses",
+};
+
+#ifdef __linux__
+
+static const uint64_t events[COUNTER_MAX] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static int open_event(uint64_t config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = group < 0;  // the leader starts the group
+    attr.exclude_kernel = 1;    // allowed at perf_event_paranoid 2
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+int counters_open(counters *c) {
+    int leader = -1, err = 0;
+    c->n = 0;
+    for (int k = 0; k < COUNTER_MAX; k++) {
+        c->fd[k] = open_event(events[k], leader);
+        c->slot[k] = -1;
+        if (c->fd[k] < 0) {
+            err = errno;
+            continue;
+        }
+        if (leader < 0) {
+            leader = c->fd[k];
+        }
+        c->slot[k] = c->n++;
+    }
+    if (!c->n) {
+        fprintf(stderr, "counters: not available: %s\n", strerror(err));
+        return 0;
+    }
+    if (c->n < COUNTER_MAX) {
+        for (int k = 0; k < COUNTER_MAX; k++) {
+            if (c->fd[k] < 0) {
+                fprintf(stderr, "counters: no %s\n", names[k]);
+            }
+        }
+    }
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return c->n;
+}
+
+int counters_read(const counters *c, uint64_t v[COUNTER_MAX]) {
+    // a group read is the number of events, then their counts in the
+    // order they were opened; the leader is the first opened
+    uint64_t buf[1 + COUNTER_MAX];
+    int leader = -1;
+    for (int k = 0; k < COUNTER_MAX && leader < 0; k++) {
+        leader = c->fd[k];
+    }
+    if (leader < 0 || read(leader, buf, sizeof(buf)) < (ssize_t)(sizeof(uint64_t) * (1 + c->n))) {
+        return -1;
+    }
+    for (int k = 0; k < COUNTER_MAX; k++) {
+        v[k] = c->slot[k] < 0 ? 0 : buf[1 + c->slot[k]];
+    }
+    return 0;
+}
+
+void counters_close(counters *c) {
+    // members first, then the leader
+    for (int k = COUNTER_MAX - 1; k >= 0; k--) {
+        if (c->fd[k] >= 0) {
+            close(c->fd[k]);
+            c->fd[k] = -1;
+        }
+    }
+    c->n = 0;
+}
+
+#else
+
+int counters_open(counters *c) {
+    for (int k = 0; k < COUNTER_MAX; k++) {
+        c->fd[k] = c->slot[k] = -1;
+    }
+    c->n = 0;
+    fprintf(stderr, "counters: not available: perf_event is Linux only\n");
+    return 0;
+}
+
+int counters_read(const counters *c, uint64_t v[COUNTER_MAX]) {
+    (void)c;
+    (void)v;
+    return -1;
+}
+
+void counters_close(counters *c) {
+    c->n = 0;
+}
+
+#endif
+
+const char *counter_name(enum counter k) {
+    return names[k];
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <inttypes.h>
+
+// Hardware performance counters.
+// The cpu's cycle, instruction, cache miss and branch miss counters for
+// the calling thread, opened as one perf_event group so that a single
+// read gives all four at the same instant. Where the kernel refuses
+// (perf_event_paranoid, no PMU in a VM, not Linux) the counters are
+// left off and those that did open carry on; nothing else changes.
+
+enum counter {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_MAX,
+};
+
+typedef struct {
+    int fd[COUNTER_MAX];    // -1 for each not counted
+    int slot[COUNTER_MAX];  // place in a group read, -1 if not counted
+    int n;                  // counted
+} counters;
+
+// Returns the number of counters opened, 0 if none could be, and then
+// says why on stderr.
+int counters_open(counters *c);
+
+// The counts so far; those not counted read 0. Returns 0 on success.
+int counters_read(const counters *c, uint64_t v[COUNTER_MAX]);
+
+void counters_close(counters *c);
+
+const char *counter_name(enum counter k);
@@ -9,15 +9,20 @@ void reset_output_buffers(struct audio_data *audio) {
 
 int write_to_fftw_input_buffers(int16_t buf[], int16_t frames, struct audio_data *audio) {
 
+    // the index moves on once the block is in, so readers never see it
+    // part way through
+    int index = audio->index;
     for (uint16_t i = 0; i < frames * 2; i += 2) {
         // separate the two stereo channels
-        audio->in_l[audio->index] = buf[i];
-        audio->in_r[audio->index] = buf[i + 1];
+        audio->in_l[index] = buf[i];
+        audio->in_r[index] = buf[i + 1];
 
-        audio->index++;
-        if (audio->index == audio->FFTbufferSize - 1)
-            audio->index = 0;
+        index++;
+        if (index == audio->FFTbufferSize)
+            index = 0;
     }
+    audio->index = index;
+    audio->fill = (double)frames / audio->FFTbufferSize;
 
     return 0;
 }
@@ -14,7 +14,7 @@
 
 struct audio_data {
     int FFTbufferSize;
-    int index;
+    int index;      // where the input writes next, so its oldest sample
     double *in_r, *in_l, *windowed_l, *windowed_r;
     fftw_complex *out_l, *out_r;
     int format;
@@ -24,6 +24,8 @@ struct audio_data {
     unsigned int channels;
     int terminate;  // shared variable used to terminate audio thread
     int running;    // for shmem input
+    double fill;    // share of the input buffer the last read brought in
+    unsigned long stale;    // times playback went on with no new samples
     char error_message[1024];
 };
 
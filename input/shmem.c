@@ -1,10 +1,13 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include "input/shmem.h"
 #include "input/common.h"
 #include "debug.h"
+#include "trace.h"
+#include "probes.h"
 
 typedef unsigned int u32_t;
 typedef short s16_t;
@@ -16,6 +19,9 @@ typedef short s16_t;
 // if you were to dynamically allocate.
 #define VIS_BUF_SIZE 16384
 
+// playing without new samples for this long counts as stale
+#define STALE_NS 100000000L
+
 // format of shmem area, see squeezelite's output_vis.h
 typedef struct {
     pthread_rwlock_t rwlock;
@@ -40,13 +46,22 @@ void *input_shmem(void *data) {
     // This loop can go very fast indeed with minimal performance impact
     // and the benefit is fresh data for the high frequencies and no flicker.
     struct timespec req = {.tv_sec = 0, .tv_nsec = 1e9 / 3000};
-    // 0.1s long sleep when not playing to lower CPU usage
-    struct timespec req_silence = {.tv_sec = 0, .tv_nsec = 1e8};
+    // 0.1s long sleep when not playing to lower CPU usage, doubling
+    // up to 0.8s while it stays stopped
+    long silence_ns = 0;
+
+    // when buf_index last moved, to notice squeezelite falling behind
+    u32_t last_index = 0;
+    double fill = 0;
+    struct timespec last_change, now;
+    bool stale = false;
+    clock_gettime(CLOCK_MONOTONIC, &last_change);
 
     s16_t silence_buffer[VIS_BUF_SIZE];
     memset(silence_buffer, 0, sizeof(s16_t) * VIS_BUF_SIZE);
 
     debug("input_shmem: source: %s\n", audio->source);
+    trace_thread("input");
 
     fd = shm_open(audio->source, O_RDONLY, 0666);
 
@@ -66,12 +81,49 @@ void *input_shmem(void *data) {
         audio->rate = mmap_area->rate;
         audio->running = mmap_area->running;
         buf_frames = mmap_area->buf_size / 2;       // there are two channels
-        audio->index = (audio->FFTbufferSize - mmap_area->buf_index / 2) % audio->FFTbufferSize;
         if (mmap_area->running) {
-            write_to_fftw_input_buffers(mmap_area->buffer, buf_frames, audio);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (mmap_area->buf_index != last_index) {
+                // the share of the ring written since the last poll; near
+                // 1 squeezelite is lapping us and samples are lost
+                u32_t size = mmap_area->buf_size ? mmap_area->buf_size : VIS_BUF_SIZE;
+                fill = (double)((mmap_area->buf_index + size - last_index) % size) / size;
+                last_index = mmap_area->buf_index;
+                PROBE2(input_block, last_index, audio->rate);
+                last_change = now;
+                stale = false;
+            } else if (!stale && (now.tv_sec - last_change.tv_sec) * 1000000000L +
+                    now.tv_nsec - last_change.tv_nsec > STALE_NS) {
+                stale = true;
+                audio->stale++;
+                trace_instant("stale");
+            }
+            // oldest first from buf_index; a whole ring brings the index
+            // back round, so the buffers stay in time order from 0
+            int oldest = buf_frames ? (int)(mmap_area->buf_index / 2) % buf_frames : 0;
+            trace_begin("copy");
+            write_to_fftw_input_buffers(mmap_area->buffer + 2 * oldest, buf_frames - oldest, audio);
+            write_to_fftw_input_buffers(mmap_area->buffer, oldest, audio);
+            trace_end("copy");
+            // the whole ring is copied each time, so its share says nothing
+            audio->fill = fill;
+            silence_ns = 0;
             nanosleep(&req, NULL);
         } else {
-            write_to_fftw_input_buffers(silence_buffer, buf_frames, audio);
+            // stopped is not stale
+            clock_gettime(CLOCK_MONOTONIC, &last_change);
+            stale = false;
+            fill = 0;
+            // the buffers only need clearing once
+            if (!silence_ns) {
+                write_to_fftw_input_buffers(silence_buffer, buf_frames, audio);
+                audio->fill = 0;
+                silence_ns = 1e8;
+            } else if (silence_ns < 8e8) {
+                silence_ns *= 2;
+            }
+            struct timespec req_silence = {.tv_sec = silence_ns / 1000000000,
+                                           .tv_nsec = silence_ns % 1000000000};
             nanosleep(&req_silence, NULL);
         }
     }
@@ -0,0 +1,101 @@
+#include <math.h>
+#include <time.h>
+
+#include "input/synth.h"
+#include "input/common.h"
+#include "debug.h"
+
+// Synthetic input, for spectrum --bench: test signals in turn, each for
+// SYNTH_PERIOD seconds, written in blocks as they would arrive from a
+// player so that the input thread costs what it does in use:
+// a logarithmic sine sweep from 20 Hz to 20 kHz, pink noise, and a
+// square driven past full scale, so clipped flat.
+
+#define SYNTH_RATE 44100
+#define SYNTH_BLOCK 256         // frames written at a time
+#define SYNTH_PERIOD 1.0        // s of each signal
+#define SYNTH_SIGNALS 3
+
+static double white(uint32_t *state) {
+    // xorshift32, uniform in [-1, 1)
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state / 2147483648.0 - 1;
+}
+
+static double pink(double b[7], uint32_t *state) {
+    // Paul Kellet's filter of white noise, within 0.05 dB of -3 dB per
+    // octave above 9 Hz at 44.1 kHz; about full scale at most
+    double w = white(state);
+    b[0] = 0.99886 * b[0] + w * 0.0555179;
+    b[1] = 0.99332 * b[1] + w * 0.0750759;
+    b[2] = 0.96900 * b[2] + w * 0.1538520;
+    b[3] = 0.86650 * b[3] + w * 0.3104856;
+    b[4] = 0.55000 * b[4] + w * 0.5329522;
+    b[5] = -0.7616 * b[5] - w * 0.0168980;
+    double y = b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + w * 0.5362;
+    b[6] = w * 0.115926;
+    return y * 0.2;
+}
+
+static int16_t sample(double x) {
+    x = round(x * 32767);
+    return x > 32767 ? 32767 : x < -32768 ? -32768 : (int16_t)x;
+}
+
+static void advance(struct timespec *t, long ns) {
+    t->tv_nsec += ns;
+    while (t->tv_nsec >= 1000000000L) {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000L;
+    }
+}
+
+// input: SYNTH
+void *input_synth(void *data) {
+    struct audio_data *audio = (struct audio_data *)data;
+    int16_t buf[2 * SYNTH_BLOCK];
+    double phase = 0, pink_l[7] = {0}, pink_r[7] = {0};
+    uint32_t state_l = 1, state_r = 2;
+    long frames = 0;
+    struct timespec next;
+
+    debug("input_synth: %d Hz\n", SYNTH_RATE);
+    audio->format = 16;
+    audio->rate = SYNTH_RATE;
+    audio->running = 1;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!audio->terminate) {
+        for (int i = 0; i < SYNTH_BLOCK; i++, frames++) {
+            double t = (double)frames / SYNTH_RATE;
+            double at = fmod(t, SYNTH_PERIOD) / SYNTH_PERIOD;
+            double l, r;
+            switch ((long)(t / SYNTH_PERIOD) % SYNTH_SIGNALS) {
+            case 0:
+                // 20 Hz to 20 kHz over the period, at -6 dB
+                phase += 2 * M_PI * 20 * pow(1000, at) / SYNTH_RATE;
+                phase = fmod(phase, 2 * M_PI);
+                l = r = 0.5 * sin(phase);
+                break;
+            case 1:
+                l = pink(pink_l, &state_l);
+                r = pink(pink_r, &state_r);
+                break;
+            default:
+                // 440 Hz at twice full scale
+                l = r = fmod(t * 440, 1) < 0.5 ? 2 : -2;
+                break;
+            }
+            buf[2 * i] = sample(l);
+            buf[2 * i + 1] = sample(r);
+        }
+        write_to_fftw_input_buffers(buf, SYNTH_BLOCK, audio);
+
+        // the next block when a player would have sent it
+        advance(&next, 1000000000L * SYNTH_BLOCK / SYNTH_RATE);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    return 0;
+}
@@ -0,0 +1,5 @@
+// header file for synth, part of spectrum.
+
+#pragma once
+
+void *input_synth(void *data);
@@ -0,0 +1,95 @@
+#include <math.h>
+
+#include "layout.h"
+#include "sigproc.h"
+
+#include "util.h"
+
+#define DESIGN_W 800
+#define DESIGN_H 480
+
+static int scaled(const layout *l, double v) {
+    // at least a pixel (or a point) for anything non-zero
+    int s = (int)lround(v * l->scale);
+    return (v > 0 && s < 1) ? 1 : s;
+}
+
+void layout_init(layout *l, uint32_t w, uint32_t h) {
+    l->w = w;
+    l->h = h;
+    l->scale = fmin((double)w / DESIGN_W, (double)h / DESIGN_H);
+
+    // fft: bars over the whole screen, meters and labels underneath
+    fft_layout *f = &l->fft;
+    f->ax.screen_x = 0;
+    f->ax.screen_y = 0;
+    f->ax.screen_w = w - 1;
+    f->ax.screen_h = h;
+    f->ax.base = scaled(l, 120);
+    f->ax.x_min = log10(LOWER_CUTOFF_FREQ);
+    f->ax.x_max = log10(UPPER_CUTOFF_FREQ);
+    f->ax.y_min = -1000;    // dB
+    f->ax.y_max = 500;
+    f->bars = 30;
+    f->font = scaled(l, 8);
+    f->font_info = scaled(l, 9);
+    f->label_x = scaled(l, 20);
+    f->meter_x = scaled(l, 60);
+    f->meter_l_y = scaled(l, 85);
+    f->meter_r_y = scaled(l, 45);
+    f->meter_h = scaled(l, 10);
+    f->meter_len = (int)w - 1 - scaled(l, 160);
+    f->meter_dB = 15 * l->scale;
+    f->reading_x = (int)w - 1 - scaled(l, 60);
+    f->date_x = scaled(l, 60);
+    f->date_y = scaled(l, 10);
+    f->rate_x = (int)w - scaled(l, 90);
+    f->rate_y = scaled(l, 10);
+
+    // ppm: a dial at each side, half off the screen
+    ppm_layout *p = &l->ppm;
+    p->font = scaled(l, 8);
+    p->font_title = scaled(l, 10);
+    p->font_unit = scaled(l, 16);
+    p->r = scaled(l, 180);
+    p->x0 = scaled(l, 80);
+    p->xr0 = (int)w - scaled(l, 80);
+    p->y0 = (int)h / 2;
+    p->tick_in = p->r + scaled(l, 3);
+    p->tick_short = p->r + scaled(l, 10);
+    p->tick_long = p->r + scaled(l, 22);
+    p->tick_w = scaled(l, 3);
+    p->label_r = p->r + scaled(l, 30);
+    p->label_dx[0] = -scaled(l, 20);
+    p->label_dy[0] = -scaled(l, 20);
+    p->label_dx[1] = scaled(l, 3);
+    p->label_dy[1] = scaled(l, 8);
+    p->label_dx[2] = -scaled(l, 10);
+    p->label_dy[2] = 0;
+    p->excess_in = p->r + scaled(l, 10);
+    p->excess_w = scaled(l, 5);
+    p->excess_glow_w = scaled(l, 6);
+    p->arc_w = scaled(l, 2);
+    p->needle_in = p->r - scaled(l, 160);
+    p->needle_out = p->r + scaled(l, 20);
+    p->needle_w = scaled(l, 5);
+    p->title_x = (int)w / 2 - scaled(l, 40);
+    p->title_y = (int)h - scaled(l, 80);
+    p->reading_l_x = scaled(l, 10);
+    p->reading_r_x = (int)w - 1 - scaled(l, 60);
+    p->rate_x = (int)w / 2 - scaled(l, 40);
+    p->rate_y = scaled(l, 80);
+
+    // clock, while paused
+    l->clock.font_time = scaled(l, 64);
+    l->clock.font_date = scaled(l, 14);
+    l->clock.time_y = scaled(l, 200);
+    l->clock.date_y = scaled(l, 80);
+
+    // performance overlay, top left
+    l->overlay.font = scaled(l, 5);
+    l->overlay.line = scaled(l, 20);
+    l->overlay.x = scaled(l, 8);
+    l->overlay.y = (int)h - l->overlay.line;
+    l->overlay.w = scaled(l, 220);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "output/fbplot.h"
+
+// Screen layout of each vis, worked out once from the buffer size.
+// Everything is scaled from the 800x480 screen the vis were designed
+// on, by the smaller of the two ratios so that nothing runs off.
+
+typedef struct {
+    axes ax;                // bars and their ticks
+    int bars;
+    int font, font_info;
+    int label_x;            // "L" and "R"
+    int meter_x, meter_l_y, meter_r_y, meter_h;
+    int meter_len;          // at 0 dB
+    double meter_dB;        // pixels per dB
+    int reading_x;
+    int date_x, date_y;
+    int rate_x, rate_y;
+} fft_layout;
+
+typedef struct {
+    int font, font_title, font_unit;
+    int r;                  // dial radius
+    int x0, xr0, y0;        // left and right needle origins
+    int tick_in, tick_short, tick_long, tick_w;
+    int label_r;
+    int label_dx[3], label_dy[3];   // of the -50, 0 and +5 labels
+    int excess_in, excess_w, excess_glow_w;
+    int arc_w;
+    int needle_in, needle_out, needle_w;
+    int title_x, title_y;
+    int reading_l_x, reading_r_x;
+    int rate_x, rate_y;
+} ppm_layout;
+
+typedef struct {
+    int font_time, font_date;
+    int time_y, date_y;
+} clock_layout;
+
+typedef struct {
+    int font;
+    int x, y;               // baseline of the first line
+    int line;               // from one baseline to the next
+    int w;                  // of the box behind the text
+} overlay_layout;
+
+typedef struct {
+    uint32_t w, h;
+    double scale;
+    fft_layout fft;
+    ppm_layout ppm;
+    clock_layout clock;
+    overlay_layout overlay;
+} layout;
+
+void layout_init(layout *l, uint32_t w, uint32_t h);
@@ -0,0 +1,176 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+
+#include "debug.h"
+
+// upper bounds of the stage histogram buckets, s
+static const double le[] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 1,
+};
+
+static void counter(FILE *f, const char *name, const char *help, double v) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s counter\n%s %.17g\n", name, help, name, name, v);
+}
+
+static void gauge(FILE *f, const char *name, const char *help, double v) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s gauge\n%s %.17g\n", name, help, name, name, v);
+}
+
+static double resident_bytes(void) {
+    // the second field of statm is resident pages
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return (double)resident * sysconf(_SC_PAGESIZE);
+}
+
+static void write_metrics(FILE *f, const metrics_snapshot *s) {
+    struct timespec cpu;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+
+    counter(f, "spectrum_frames_total", "Frames rendered.", s->frames);
+    counter(f, "spectrum_late_frames_total", "Frames that missed their deadline.", s->late);
+    counter(f, "spectrum_fft_executions_total", "FFTs executed, one per channel.", s->ffts);
+    counter(f, "spectrum_input_stale_total",
+            "Times playback went on for 0.1 s with no new samples from the input.", s->input_stale);
+    gauge(f, "spectrum_fps", "Frames per second, smoothed.", s->fps);
+    gauge(f, "spectrum_resident_memory_bytes", "Resident set size.", resident_bytes());
+    counter(f, "spectrum_cpu_seconds_total", "CPU time of the whole process.",
+            cpu.tv_sec + cpu.tv_nsec * 1e-9);
+
+    fprintf(f, "# HELP spectrum_stage_seconds Time taken by each stage of a frame.\n"
+            "# TYPE spectrum_stage_seconds histogram\n");
+    for (int i = 0; i < STAGE_MAX; i++) {
+        const histogram *h = &s->stages[i];
+        const char *name = timing_stage_name(i);
+        for (size_t j = 0; j < sizeof(le) / sizeof(le[0]); j++) {
+            fprintf(f, "spectrum_stage_seconds_bucket{stage=\"%s\",le=\"%g\"} %" PRIu64 "\n",
+                    name, le[j], timing_count_le(h, le[j]));
+        }
+        fprintf(f, "spectrum_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %" PRIu64 "\n", name, h->n);
+        fprintf(f, "spectrum_stage_seconds_sum{stage=\"%s\"} %.9f\n", name, h->sum * 1e-9);
+        fprintf(f, "spectrum_stage_seconds_count{stage=\"%s\"} %" PRIu64 "\n", name, h->n);
+    }
+}
+
+static void *serve(void *data) {
+    // answer each connection with the figures, then close it
+    metrics *m = (metrics *)data;
+    metrics_snapshot *s = malloc(sizeof(*s));
+    if (!s) {
+        return NULL;
+    }
+    for (;;) {
+        int fd = accept(m->fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;      // shut down by metrics_free
+        }
+        // a client that stops reading is dropped, not waited on
+        struct timeval timeout = {.tv_sec = 1};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        pthread_mutex_lock(&m->lock);
+        memcpy(s, &m->shared, sizeof(*s));
+        pthread_mutex_unlock(&m->lock);
+
+        char *text = NULL;
+        size_t len = 0;
+        FILE *f = open_memstream(&text, &len);
+        if (f) {
+            write_metrics(f, s);
+            fclose(f);
+            for (size_t at = 0; at < len; ) {
+                ssize_t n = send(fd, text + at, len - at, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    break;
+                }
+                at += n;
+            }
+            free(text);
+        }
+        close(fd);
+    }
+    free(s);
+    return NULL;
+}
+
+int metrics_init(metrics *m, const char *path) {
+    struct sockaddr_un addr;
+    memset(m, 0, sizeof(*m));
+    m->fd = -1;
+    pthread_mutex_init(&m->lock, NULL);
+    if (!path[0]) {
+        return 0;
+    }
+    if (strlen(path) >= sizeof(m->path) || strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    // a socket left by a previous run would stop the bind
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 4)) {
+        close(fd);
+        return -1;
+    }
+    m->fd = fd;
+    strcpy(m->path, path);
+    if (pthread_create(&m->thread, NULL, serve, m)) {
+        close(fd);
+        m->fd = -1;
+        return -1;
+    }
+    debug("metrics: serving on %s\n", path);
+    return 0;
+}
+
+void metrics_publish(metrics *m, uint64_t frames, uint64_t ffts, const pacer *pc, const timing *t,
+        const struct audio_data *audio) {
+    // if the server is copying the last figures these wait for the next frame
+    if (m->fd < 0 || pthread_mutex_trylock(&m->lock)) {
+        return;
+    }
+    metrics_snapshot *s = &m->shared;
+    s->frames = frames;
+    s->ffts = ffts;
+    s->late = pc->late;
+    s->input_stale = audio->stale;
+    s->fps = pc->achieved_fps;
+    memcpy(s->stages, t->h, sizeof(s->stages));
+    pthread_mutex_unlock(&m->lock);
+}
+
+void metrics_free(metrics *m) {
+    if (m->fd >= 0) {
+        // wakes the server from accept
+        shutdown(m->fd, SHUT_RDWR);
+        pthread_join(m->thread, NULL);
+        close(m->fd);
+        unlink(m->path);
+        m->fd = -1;
+    }
+    pthread_mutex_destroy(&m->lock);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "pacer.h"
+#include "timing.h"
+#include "input/common.h"
+
+// Metrics export.
+// Counters, gauges and the frame stage histograms are served in the
+// Prometheus text format to whoever connects to a Unix socket, e.g.
+// socat - UNIX-CONNECT:/run/spectrum.sock. A thread of its own answers;
+// the render loop only hands it a copy of the figures each frame, and
+// skips that if the thread is reading the last one, so it never waits.
+
+typedef struct {
+    uint64_t frames;
+    uint64_t ffts;
+    unsigned long late;
+    unsigned long input_stale;
+    double fps;
+    histogram stages[STAGE_MAX];
+} metrics_snapshot;
+
+typedef struct {
+    int fd;                     // listening socket; -1 if not serving
+    char path[108];             // of the socket, removed at exit
+    pthread_t thread;
+    pthread_mutex_t lock;       // of shared
+    metrics_snapshot shared;
+} metrics;
+
+// Serve on path; an empty path serves nothing. Returns 0 on success.
+int metrics_init(metrics *m, const char *path);
+
+void metrics_publish(metrics *m, uint64_t frames, uint64_t ffts, const pacer *pc, const timing *t,
+        const struct audio_data *audio);
+
+void metrics_free(metrics *m);
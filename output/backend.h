@@ -0,0 +1,31 @@
+// Output backends, part of spectrum.
+//
+// A backend provides the screen memory that fb_blit writes to and
+// describes its format. fbdev maps a Linux framebuffer device; headless
+// keeps the screen in memory and can dump each frame, so the whole
+// pipeline runs on machines without a display.
+
+#pragma once
+
+#include <linux/fb.h>
+#include <inttypes.h>
+
+#include "framebuffer.h"
+
+typedef struct {
+    const char *name;
+    // fill in the screen format and map its memory, 0 on success
+    int (*open)(const fb_options *o, struct fb_var_screeninfo *vinfo,
+            struct fb_fix_screeninfo *finfo, uint8_t **mem);
+    // block until the screen is ready for a new frame, if it can tell
+    void (*wait)(void);
+    // a complete frame is in mem
+    void (*present)(const uint8_t *mem);
+    void (*close)(uint8_t *mem);
+    // turn the panel off or back on, 0 on success; NULL if there is
+    // no panel
+    int (*blank)(int blank);
+} fb_backend;
+
+extern const fb_backend fb_backend_fbdev;
+extern const fb_backend fb_backend_headless;
@@ -0,0 +1,98 @@
+// Panel backlight, part of spectrum.
+//
+// https://www.kernel.org/doc/Documentation/ABI/stable/sysfs-class-backlight
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <limits.h>
+
+#include "debug.h"
+#include "backlight.h"
+
+#define BACKLIGHTS "/sys/class/backlight"
+
+static char dir[PATH_MAX];
+static int saved = -1;      // brightness before powering off without bl_power
+
+static int write_int(const char *name, int v) {
+    char path[PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        return -1;
+    }
+    int err = fprintf(fp, "%d\n", v) < 0;
+    err |= fclose(fp) != 0;
+    return err ? -1 : 0;
+}
+
+static int read_int(const char *name, int *v) {
+    char path[PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return -1;
+    }
+    int err = fscanf(fp, "%d", v) != 1;
+    fclose(fp);
+    return err ? -1 : 0;
+}
+
+int bl_init(const char *path) {
+    // Use the backlight at path, or the first one there is if it is
+    // empty. Returns 0 if there is one.
+    dir[0] = '\0';
+    if (path && path[0]) {
+        snprintf(dir, sizeof(dir), "%s", path);
+        return 0;
+    }
+    DIR *d = opendir(BACKLIGHTS);
+    if (!d) {
+        return -1;
+    }
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        if (e->d_name[0] != '.') {
+            snprintf(dir, sizeof(dir), "%s/%s", BACKLIGHTS, e->d_name);
+            break;
+        }
+    }
+    closedir(d);
+    debug("backlight: %s\n", dir[0] ? dir : "none");
+    return dir[0] ? 0 : -1;
+}
+
+int bl_set_brightness(int brightness) {
+    if (!dir[0]) {
+        return -1;
+    }
+    int max;
+    if (!read_int("max_brightness", &max) && brightness > max) {
+        brightness = max;
+    }
+    return write_int("brightness", brightness);
+}
+
+int bl_power(int on) {
+    // bl_power takes the FB_BLANK_* values; without it, turn the
+    // brightness down to 0 and back
+    if (!dir[0]) {
+        return -1;
+    }
+    if (!write_int("bl_power", on ? 0 : 4)) {
+        return 0;
+    }
+    if (!on) {
+        if (saved < 0 && read_int("brightness", &saved)) {
+            return -1;
+        }
+        return write_int("brightness", 0);
+    }
+    if (saved < 0) {
+        return 0;
+    }
+    int err = write_int("brightness", saved);
+    saved = -1;
+    return err;
+}
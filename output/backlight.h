@@ -0,0 +1,12 @@
+// Panel backlight, part of spectrum.
+//
+// Through the sysfs backlight class, for panels whose framebuffer
+// driver cannot blank them and to set their brightness.
+
+#pragma once
+
+int bl_init(const char *dir);
+
+int bl_set_brightness(int brightness);
+
+int bl_power(int on);
@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "displaylist.h"
+#include "util.h"
+
+void dl_init(display_list *dl, const buffer target) {
+    memset(dl, 0, sizeof(*dl));
+    dl->target = target;
+}
+
+void dl_free(display_list *dl) {
+    free(dl->cmds);
+    free(dl->arena);
+    memset(dl, 0, sizeof(*dl));
+}
+
+void dl_reset(display_list *dl) {
+    // keep the memory for the next frame
+    dl->n = 0;
+    dl->used = 0;
+    dl->frame++;
+}
+
+static dl_cmd *push(display_list *dl, enum dl_op op) {
+    if (dl->n == dl->cap) {
+        size_t cap = dl->cap ? 2 * dl->cap : 64;
+        dl_cmd *cmds = realloc(dl->cmds, cap * sizeof(dl_cmd));
+        if (!cmds) {
+            return NULL;
+        }
+        dl->cmds = cmds;
+        dl->cap = cap;
+    }
+    dl_cmd *cmd = &dl->cmds[dl->n++];
+    cmd->op = op;
+    return cmd;
+}
+
+static size_t store(display_list *dl, const void *data, size_t bytes) {
+    // copy into the arena, 8-byte aligned; returns the offset or SIZE_MAX
+    size_t at = (dl->used + 7) & ~(size_t)7;
+    if (at + bytes > dl->size) {
+        size_t size = max(2 * dl->size, at + bytes);
+        uint8_t *arena = realloc(dl->arena, size);
+        if (!arena) {
+            return SIZE_MAX;
+        }
+        dl->arena = arena;
+        dl->size = size;
+    }
+    memcpy(dl->arena + at, data, bytes);
+    dl->used = at + bytes;
+    return at;
+}
+
+void dl_clear(display_list *dl) {
+    push(dl, DL_CLEAR);
+}
+
+void dl_paste(display_list *dl, const buffer src) {
+    // src in place of a clear, as a skin's face is drawn
+    dl_cmd *cmd = push(dl, DL_PASTE);
+    if (cmd) {
+        cmd->u.paste.src = src;
+    }
+}
+
+void dl_fill_rect(display_list *dl, int x, int y, int w, int h, pixel p) {
+    dl_cmd *cmd = push(dl, DL_FILL_RECT);
+    if (cmd) {
+        cmd->u.rect.x = x;
+        cmd->u.rect.y = y;
+        cmd->u.rect.w = w;
+        cmd->u.rect.h = h;
+        cmd->u.rect.p = p;
+    }
+}
+
+static void line(display_list *dl, enum dl_op op, int x0, int y0, int x1, int y1, int thickness, rgba c) {
+    dl_cmd *cmd = push(dl, op);
+    if (cmd) {
+        cmd->u.line.x0 = x0;
+        cmd->u.line.y0 = y0;
+        cmd->u.line.x1 = x1;
+        cmd->u.line.y1 = y1;
+        cmd->u.line.thickness = thickness;
+        cmd->u.line.c = c;
+    }
+}
+
+void dl_draw_line(display_list *dl, int x0, int y0, int x1, int y1, rgba c) {
+    line(dl, DL_LINE, x0, y0, x1, y1, 1, c);
+}
+
+void dl_draw_thick_line(display_list *dl, int x0, int y0, int x1, int y1, int thickness, rgba c) {
+    line(dl, DL_THICK_LINE, x0, y0, x1, y1, thickness, c);
+}
+
+void dl_draw_arc(display_list *dl, int x0, int y0, int radius, double theta0, double theta1, int thickness, rgba c) {
+    dl_cmd *cmd = push(dl, DL_ARC);
+    if (cmd) {
+        cmd->u.arc.x0 = x0;
+        cmd->u.arc.y0 = y0;
+        cmd->u.arc.r = radius;
+        cmd->u.arc.thickness = thickness;
+        cmd->u.arc.theta0 = theta0;
+        cmd->u.arc.theta1 = theta1;
+        cmd->u.arc.c = c;
+    }
+}
+
+void dl_draw_ray(display_list *dl, int x0, int y0, int r0, int r1, double theta, int thickness, rgba c) {
+    dl_cmd *cmd = push(dl, DL_RAY);
+    if (cmd) {
+        cmd->u.ray.x0 = x0;
+        cmd->u.ray.y0 = y0;
+        cmd->u.ray.r0 = r0;
+        cmd->u.ray.r1 = r1;
+        cmd->u.ray.thickness = thickness;
+        cmd->u.ray.theta = theta;
+        cmd->u.ray.c = c;
+    }
+}
+
+void dl_text(display_list *dl, char *text, int num_chars, int size, int center, uint32_t x, uint32_t y, int style, rgba c) {
+    text_mask tm;
+    if (bf_text_mask(dl->target, text, num_chars, size, center, x, y, style, &tm) || !tm.mask) {
+        return;
+    }
+    size_t at = store(dl, tm.mask, (size_t)tm.w * tm.h);
+    free(tm.mask);
+    dl_cmd *cmd = at == SIZE_MAX ? NULL : push(dl, DL_MASK);
+    if (cmd) {
+        cmd->u.mask.x = tm.x;
+        cmd->u.mask.y = tm.y;
+        cmd->u.mask.w = tm.w;
+        cmd->u.mask.h = tm.h;
+        cmd->u.mask.mask = at;
+        cmd->u.mask.p = rgba_to_pixel(c);
+    }
+}
+
+void dl_sprite(display_list *dl, int x, int y, const sprite *s, rgba c) {
+    dl_cmd *cmd = s ? push(dl, DL_SPRITE) : NULL;
+    if (cmd) {
+        cmd->u.sprite.x = x;
+        cmd->u.sprite.y = y;
+        cmd->u.sprite.s = s;
+        cmd->u.sprite.p = rgba_to_pixel(c);
+    }
+}
+
+static void plot(display_list *dl, enum dl_op op, const axes ax, const void *data, size_t bytes, uint32_t n, rgba c, rgba c2) {
+    size_t at = data ? store(dl, data, bytes) : 0;
+    dl_cmd *cmd = at == SIZE_MAX ? NULL : push(dl, op);
+    if (cmd) {
+        cmd->u.plot.ax = ax;
+        cmd->u.plot.data = at;
+        cmd->u.plot.n = n;
+        cmd->u.plot.c = c;
+        cmd->u.plot.c2 = c2;
+    }
+}
+
+void dl_plot_bars(display_list *dl, const axes ax, const int data[], uint32_t num_points, rgba c) {
+    plot(dl, DL_BARS, ax, data, num_points * sizeof(int), num_points, c, c);
+}
+
+void dl_plot_line(display_list *dl, const axes ax, const double data[], uint32_t num_points, rgba c) {
+    plot(dl, DL_PLOT_LINE, ax, data, num_points * sizeof(double), num_points, c, c);
+}
+
+void dl_plot_scope(display_list *dl, const axes ax, const double env[], uint32_t num_cols, rgba c) {
+    plot(dl, DL_SCOPE, ax, env, 2 * num_cols * sizeof(double), num_cols, c, c);
+}
+
+void dl_plot_axes(display_list *dl, const axes ax, const rgba c1, const rgba c2) {
+    plot(dl, DL_AXES, ax, NULL, 0, 0, c1, c2);
+}
+
+void dl_render(const display_list *dl, const buffer buff) {
+    for (size_t i = 0; i < dl->n; i++) {
+        const dl_cmd *cmd = &dl->cmds[i];
+        switch (cmd->op) {
+        case DL_CLEAR:
+            bf_fill_rect(buff, 0, 0, (int)buff.w, (int)buff.h, 0);
+            break;
+        case DL_PASTE:
+            bf_paste(buff, cmd->u.paste.src);
+            break;
+        case DL_FILL_RECT:
+            bf_fill_rect(buff, cmd->u.rect.x, cmd->u.rect.y, cmd->u.rect.w, cmd->u.rect.h, cmd->u.rect.p);
+            break;
+        case DL_LINE:
+            bf_draw_line(buff, cmd->u.line.x0, cmd->u.line.y0, cmd->u.line.x1, cmd->u.line.y1, cmd->u.line.c);
+            break;
+        case DL_THICK_LINE:
+            bf_draw_thick_line(buff, cmd->u.line.x0, cmd->u.line.y0, cmd->u.line.x1, cmd->u.line.y1,
+                    cmd->u.line.thickness, cmd->u.line.c);
+            break;
+        case DL_ARC:
+            bf_draw_arc(buff, cmd->u.arc.x0, cmd->u.arc.y0, cmd->u.arc.r,
+                    cmd->u.arc.theta0, cmd->u.arc.theta1, cmd->u.arc.thickness, cmd->u.arc.c);
+            break;
+        case DL_RAY:
+            bf_draw_ray(buff, cmd->u.ray.x0, cmd->u.ray.y0, cmd->u.ray.r0, cmd->u.ray.r1,
+                    cmd->u.ray.theta, cmd->u.ray.thickness, cmd->u.ray.c);
+            break;
+        case DL_MASK:
+            bf_blit_mask(buff, cmd->u.mask.x, cmd->u.mask.y, dl->arena + cmd->u.mask.mask,
+                    cmd->u.mask.w, cmd->u.mask.w, cmd->u.mask.h, cmd->u.mask.p);
+            break;
+        case DL_SPRITE:
+            bf_blit_sprite(buff, cmd->u.sprite.x, cmd->u.sprite.y, cmd->u.sprite.s, cmd->u.sprite.p);
+            break;
+        case DL_BARS:
+            bf_plot_bars(buff, cmd->u.plot.ax, (const int *)(dl->arena + cmd->u.plot.data),
+                    cmd->u.plot.n, cmd->u.plot.c);
+            break;
+        case DL_PLOT_LINE:
+            bf_plot_line(buff, cmd->u.plot.ax, (const double *)(dl->arena + cmd->u.plot.data),
+                    cmd->u.plot.n, cmd->u.plot.c);
+            break;
+        case DL_SCOPE:
+            bf_plot_scope(buff, cmd->u.plot.ax, (const double *)(dl->arena + cmd->u.plot.data),
+                    cmd->u.plot.n, cmd->u.plot.c);
+            break;
+        case DL_AXES:
+            bf_plot_axes(buff, cmd->u.plot.ax, cmd->u.plot.c, cmd->u.plot.c2);
+            break;
+        }
+    }
+}
@@ -0,0 +1,76 @@
+// A display list, part of spectrum.
+//
+// The vis code records what it draws here instead of drawing it; the
+// list is then replayed into a buffer, once or by several threads each
+// with its own clip rectangle. Text is rendered to a mask while it is
+// recorded, so replaying never calls FreeType, and data arrays are
+// copied in, so the caller may reuse them straight away. Sprites and
+// pasted buffers are not: they must last until the list has been drawn.
+
+#pragma once
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "framebuffer.h"
+#include "fbplot.h"
+
+enum dl_op {
+    DL_CLEAR,
+    DL_PASTE,
+    DL_FILL_RECT,
+    DL_LINE,
+    DL_THICK_LINE,
+    DL_ARC,
+    DL_RAY,
+    DL_MASK,
+    DL_SPRITE,
+    DL_BARS,
+    DL_PLOT_LINE,
+    DL_SCOPE,
+    DL_AXES,
+};
+
+typedef struct {
+    enum dl_op op;
+    union {
+        struct { int x, y, w, h; pixel p; } rect;
+        struct { int x0, y0, x1, y1, thickness; rgba c; } line;
+        struct { int x0, y0, r, thickness; double theta0, theta1; rgba c; } arc;
+        struct { int x0, y0, r0, r1, thickness; double theta; rgba c; } ray;
+        struct { int x, y, w, h; size_t mask; pixel p; } mask;
+        struct { int x, y; const sprite *s; pixel p; } sprite;
+        struct { buffer src; } paste;
+        struct { axes ax; size_t data; uint32_t n; rgba c, c2; } plot;
+    } u;
+} dl_cmd;
+
+typedef struct {
+    buffer target;      // the buffer being recorded for, for its size
+    dl_cmd *cmds;
+    size_t n, cap;
+    uint8_t *arena;     // masks and data, referred to by offset
+    size_t used, size;
+    uint64_t frame;     // counts resets
+} display_list;
+
+void dl_init(display_list *dl, const buffer target);
+void dl_free(display_list *dl);
+void dl_reset(display_list *dl);
+
+void dl_clear(display_list *dl);
+void dl_paste(display_list *dl, const buffer src);
+void dl_fill_rect(display_list *dl, int x, int y, int w, int h, pixel p);
+void dl_draw_line(display_list *dl, int x0, int y0, int x1, int y1, rgba c);
+void dl_draw_thick_line(display_list *dl, int x0, int y0, int x1, int y1, int thickness, rgba c);
+void dl_draw_arc(display_list *dl, int x0, int y0, int radius, double theta0, double theta1, int thickness, rgba c);
+void dl_draw_ray(display_list *dl, int x0, int y0, int r0, int r1, double theta, int thickness, rgba c);
+void dl_text(display_list *dl, char *text, int num_chars, int size, int center, uint32_t x, uint32_t y, int style, rgba c);
+void dl_sprite(display_list *dl, int x, int y, const sprite *s, rgba c);
+void dl_plot_bars(display_list *dl, const axes ax, const int data[], uint32_t num_points, rgba c);
+void dl_plot_line(display_list *dl, const axes ax, const double data[], uint32_t num_points, rgba c);
+void dl_plot_scope(display_list *dl, const axes ax, const double env[], uint32_t num_cols, rgba c);
+void dl_plot_axes(display_list *dl, const axes ax, const rgba c1, const rgba c2);
+
+// draw everything recorded, within buff's clip rectangle
+void dl_render(const display_list *dl, const buffer buff);
@@ -0,0 +1,70 @@
+// fbdev output backend, part of spectrum.
+//
+// framebuffer documentation:
+// https://www.kernel.org/doc/Documentation/fb/api.txt
+
+#include <stdio.h>
+#include <linux/fb.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "backend.h"
+
+static int fd = -1;
+static size_t size;
+
+static int fbdev_open(const fb_options *o, struct fb_var_screeninfo *vinfo,
+        struct fb_fix_screeninfo *finfo, uint8_t **mem) {
+    fd = open(o->device, O_RDWR);
+    if (fd < 0) {
+        perror(o->device);
+        return -1;
+    }
+    ioctl(fd, FBIOGET_VSCREENINFO, vinfo);
+    if (o->bpp && (vinfo->bits_per_pixel != (uint32_t)o->bpp)) {
+        // the driver may refuse or pick another depth, so read it back
+        vinfo->grayscale = 0;
+        vinfo->bits_per_pixel = o->bpp;
+        ioctl(fd, FBIOPUT_VSCREENINFO, vinfo);
+        ioctl(fd, FBIOGET_VSCREENINFO, vinfo);
+    }
+    ioctl(fd, FBIOGET_FSCREENINFO, finfo);
+
+    size = vinfo->yres * finfo->line_length;
+    *mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (*mem == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static void fbdev_wait(void) {
+    ioctl(fd, FBIO_WAITFORVSYNC, 0);
+}
+
+static void fbdev_present(const uint8_t *mem) {
+    // the device scans out of mem directly
+    (void)mem;
+}
+
+static void fbdev_close(uint8_t *mem) {
+    munmap(mem, size);
+    close(fd);
+    fd = -1;
+}
+
+static int fbdev_blank(int blank) {
+    // not every driver can, SPI panels often cannot
+    return ioctl(fd, FBIOBLANK, blank ? FB_BLANK_POWERDOWN : FB_BLANK_UNBLANK);
+}
+
+const fb_backend fb_backend_fbdev = {
+    "fbdev", fbdev_open, fbdev_wait, fbdev_present, fbdev_close, fbdev_blank,
+};
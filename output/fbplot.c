@@ -10,6 +10,8 @@
 #include "debug.h"
 #include "framebuffer.h"
 #include "fbplot.h"
+#include "pixops.h"
+#include "sdffont.h"
 #include "util.h"
 
 
@@ -17,6 +19,10 @@ FT_Library library;
 FT_Face text_face;
 FT_Face audio_face;
 
+// distance field atlases of the audio and text faces, if in use
+static sdf_font sdf[2];
+static int sdf_on;
+
 
 void freetype_init(char *text_font, char *audio_font) {
     int error = FT_Init_FreeType(&library);
@@ -43,33 +49,36 @@ void freetype_init(char *text_font, char *audio_font) {
     }
 } 
 
+int freetype_sdf(const char *text_font, const char *audio_font, const char *cache_dir) {
+    // draw text from distance field atlases of the faces instead
+    sdf_on = !sdf_load(&sdf[0], audio_face, audio_font, cache_dir) &&
+        !sdf_load(&sdf[1], text_face, text_font, cache_dir);
+    if (!sdf_on) {
+        sdf_free(&sdf[0]);
+        sdf_free(&sdf[1]);
+        return -1;
+    }
+    return 0;
+}
+
 void freetype_cleanup() {
+    sdf_on = 0;
+    sdf_free(&sdf[0]);
+    sdf_free(&sdf[1]);
     FT_Done_Face(text_face);
     FT_Done_Face(audio_face);
     FT_Done_FreeType(library);
 }
 
-rgb666 rgb_to_rgb666(rgba c) {
-    rgb666 c2 = ((c.r >> 2) << 12) | ((c.g >> 2) << 6) | (c.b >> 2);
-    return c2;
-}
-
-rgba rgb666_to_rgba(rgb666 c) {
-    rgba c2;
-    c2.r = (uint8_t)((c >> 12) << 2);
-    c2.g = (uint8_t)(((c >> 6) & 0x40) << 2);
-    c2.b = (uint8_t)((c & 0x40) << 2);
-    return c2;
-}
-
 uint8_t clamp(double c) {
     // prevent overflow
     return (uint8_t)min(255, max(0, c));
 }
 
 rgba tinge_color(rgba c1, rgba c2, double alpha) {
-    // tinge c1 with c2, c1 <- a * c2 + (1-a) * c1
-    double y1 = 0.2126 * c1.r + 0.7152 * c1.g + 0.0722 * c1.b;
+    // tinge c1 with c2, c1 <- a * y1 * c2 + (1-a) * c1
+    // with y1 the luminance of c1 in [0, 1]
+    double y1 = (0.2126 * c1.r + 0.7152 * c1.g + 0.0722 * c1.b) / 255;
     //double y2 = 0.2126 * c2.r + 0.7152 * c2.g + 0.0722 * c2.b;
     c1.r = clamp((1.0 - alpha) * (double)c1.r + y1 * alpha * (double)c2.r);
     c1.g = clamp((1.0 - alpha) * (double)c1.g + y1 * alpha * (double)c2.g);
@@ -78,26 +87,216 @@ rgba tinge_color(rgba c1, rgba c2, double alpha) {
     return c1;
 }
 
+static void sin_table_init();
+
 void bf_init(buffer *buff) {
     // set the buffer screen size and allocate memory for pixels for the buffer
-    buff->w = FRAMEBUFFER_WIDTH;
-    buff->h = FRAMEBUFFER_HEIGHT;
-    buff->size = buff->h * buff->w;
+    fb_buffer_size(&buff->w, &buff->h, &buff->stride);
+    buff->size = buff->h * buff->stride;
     debug("allocating new buffer pixels\n");
     buff->pixels = (pixel*)calloc(buff->size, sizeof(pixel));
+    bf_reset_clip(buff);
+    sin_table_init();
 }
 
 void bf_free_pixels(buffer *buff) {
     free(buff->pixels);
 }
 
+void bf_set_clip(buffer *buff, rect r) {
+    // restrict drawing to r, intersected with the buffer
+    uint32_t x1 = min(r.x + r.w, buff->w);
+    uint32_t y1 = min(r.y + r.h, buff->h);
+    buff->clip.x = min(r.x, buff->w);
+    buff->clip.y = min(r.y, buff->h);
+    buff->clip.w = x1 > buff->clip.x ? x1 - buff->clip.x : 0;
+    buff->clip.h = y1 > buff->clip.y ? y1 - buff->clip.y : 0;
+}
+
+void bf_reset_clip(buffer *buff) {
+    buff->clip.x = 0;
+    buff->clip.y = 0;
+    buff->clip.w = buff->w;
+    buff->clip.h = buff->h;
+}
+
+// The clip rectangle as half-open integer bounds.
+// Primitives work in int because their coordinates may be negative.
+typedef struct {
+    int x0, y0, x1, y1;
+} bounds;
+
+static inline bounds clip_bounds(const buffer *buff) {
+    bounds b = {
+        (int)buff->clip.x,
+        (int)buff->clip.y,
+        (int)(buff->clip.x + buff->clip.w),
+        (int)(buff->clip.y + buff->clip.h)};
+    return b;
+}
+
+// Rows are stored top to bottom, as on the screen, so that blitting is a
+// straight copy; drawing coordinates have y pointing up.
+static inline pixel *bf_row(const buffer *buff, int y) {
+    return buff->pixels + (buff->h - 1 - y) * buff->stride;
+}
+
+static inline void px_plot(const buffer *buff, const bounds *b, int x, int y, pixel p) {
+    if ((x >= b->x0) && (x < b->x1) && (y >= b->y0) && (y < b->y1)) {
+        bf_row(buff, y)[x] = p;
+    }
+}
+
+static inline pixel px_blend(pixel d, pixel s, uint32_t a) {
+    // d <- a * s + (1 - a) * d, a in [0, 255].
+    // Two 8-bit channels per multiply, so it holds for any
+    // 32 bit layout with byte-aligned channels.
+    a += a >> 7;
+    uint32_t na = 256 - a;
+    uint32_t rb = ((s & 0x00FF00FF) * a + (d & 0x00FF00FF) * na) >> 8;
+    uint32_t ag = ((s >> 8) & 0x00FF00FF) * a + ((d >> 8) & 0x00FF00FF) * na;
+    return (rb & 0x00FF00FF) | (ag & 0xFF00FF00);
+}
+
 void bf_set_pixel(buffer buff, uint32_t x, uint32_t y, rgba c) {
-    debug("i: %d\n", x * buff.h + y);
-    if ((x < buff.w) && (y < buff.h)) {
-        buff.pixels[y * buff.w + x] = rgba_to_pixel(c);
-    } else {
-        debug("set_pixel bounds broken, x: %d, y: %d\n", (int)x, (int)y);
+    bounds b = clip_bounds(&buff);
+    px_plot(&buff, &b, (int)x, (int)y, rgba_to_pixel(c));
+}
+
+void bf_hspan(const buffer buff, int x, int y, int w, pixel p) {
+    // fill w pixels of row y, starting at x
+    bounds b = clip_bounds(&buff);
+    if ((y < b.y0) || (y >= b.y1)) {
+        return;
     }
+    int x1 = min(x + w, b.x1);
+    x = max(x, b.x0);
+    pixel *row = bf_row(&buff, y);
+    for (int i = x; i < x1; i++) {
+        row[i] = p;
+    }
+}
+
+void bf_fill_rect(const buffer buff, int x, int y, int w, int h, pixel p) {
+    // fill the rectangle with lower left corner x, y
+    bounds b = clip_bounds(&buff);
+    int x1 = min(x + w, b.x1);
+    int y1 = min(y + h, b.y1);
+    x = max(x, b.x0);
+    y = max(y, b.y0);
+    for (int j = y; j < y1; j++) {
+        pixel *row = bf_row(&buff, j);
+        for (int i = x; i < x1; i++) {
+            row[i] = p;
+        }
+    }
+}
+
+void bf_blit_mask(const buffer buff, int x, int y, const uint8_t *mask, int pitch, int w, int h, pixel p) {
+    // Blend p through an 8-bit coverage mask (e.g. a glyph bitmap).
+    // Mask rows run downwards, so mask row r lands on buffer row y - r.
+    bounds b = clip_bounds(&buff);
+    int c0 = max(0, b.x0 - x);
+    int c1 = min(w, b.x1 - x);
+    int r0 = max(0, y - b.y1 + 1);
+    int r1 = min(h, y - b.y0 + 1);
+    for (int r = r0; r < r1; r++) {
+        const uint8_t *m = mask + r * pitch;
+        pixel *row = bf_row(&buff, y - r) + x;
+        for (int i = c0; i < c1; i++) {
+            if (m[i] == 0xFF) {
+                row[i] = p;
+            } else if (m[i]) {
+                row[i] = px_blend(row[i], p, m[i]);
+            }
+        }
+    }
+}
+
+void bf_blit_sprite(const buffer buff, int x, int y, const sprite *s, pixel p) {
+    // draw s with its origin at x, y
+    bounds b = clip_bounds(&buff);
+    x += s->x;
+    y += s->y;
+    int r0 = max(0, y - b.y1 + 1);
+    int r1 = min(s->h, y - b.y0 + 1);
+    for (int r = r0; r < r1; r++) {
+        int c0 = max(s->row[r].x, b.x0 - x);
+        int c1 = min(s->row[r].x + s->row[r].w, b.x1 - x);
+        if (c0 >= c1) {
+            continue;
+        }
+        size_t at = s->row[r].at - s->row[r].x;
+        const uint8_t *m = s->mask + at;
+        pixel *row = bf_row(&buff, y - r) + x;
+        if (s->image) {
+            const pixel *q = s->image + at;
+            for (int i = c0; i < c1; i++) {
+                if (m[i] == 0xFF) {
+                    row[i] = q[i];
+                } else if (m[i]) {
+                    row[i] = px_blend(row[i], q[i], m[i]);
+                }
+            }
+        } else {
+            for (int i = c0; i < c1; i++) {
+                if (m[i] == 0xFF) {
+                    row[i] = p;
+                } else if (m[i]) {
+                    row[i] = px_blend(row[i], p, m[i]);
+                }
+            }
+        }
+    }
+}
+
+int bf_sprite_pack(sprite *s, int w, int h, const uint8_t *mask, const pixel *image) {
+    // Keep the covered span of each row of a w by h picture, with
+    // s->x, s->y already set. image may be NULL.
+    size_t n = 0;
+    s->h = h;
+    s->row = malloc(h * sizeof(*s->row));
+    if (!s->row) {
+        return -1;
+    }
+    for (int r = 0; r < h; r++) {
+        const uint8_t *m = mask + (size_t)r * w;
+        int lo = 0, hi = w;
+        while (lo < hi && !m[lo]) {
+            lo++;
+        }
+        while (hi > lo && !m[hi - 1]) {
+            hi--;
+        }
+        s->row[r].x = lo;
+        s->row[r].w = hi - lo;
+        s->row[r].at = n;
+        n += hi - lo;
+    }
+    s->mask = malloc(n ? n : 1);
+    s->image = image ? malloc((n ? n : 1) * sizeof(pixel)) : NULL;
+    if (!s->mask || (image && !s->image)) {
+        bf_sprite_free(s);
+        return -1;
+    }
+    for (int r = 0; r < h; r++) {
+        size_t from = (size_t)r * w + s->row[r].x;
+        memcpy(s->mask + s->row[r].at, mask + from, s->row[r].w);
+        if (image) {
+            memcpy(s->image + s->row[r].at, image + from, s->row[r].w * sizeof(pixel));
+        }
+    }
+    return 0;
+}
+
+void bf_sprite_free(sprite *s) {
+    free(s->row);
+    free(s->mask);
+    free(s->image);
+    s->row = NULL;
+    s->mask = NULL;
+    s->image = NULL;
+    s->h = 0;
 }
 
 void bf_clear(const buffer buff) {
@@ -105,8 +304,10 @@ void bf_clear(const buffer buff) {
 }
 
 void bf_fill(const buffer buff, const rgba c) {
-    // FIXME: write with stride of every fourth byte
-    memset(buff.pixels, rgba_to_pixel(c), sizeof(pixel) * buff.size);
+    pixel p = rgba_to_pixel(c);
+    for (uint32_t i = 0; i < buff.size; i++) {
+        buff.pixels[i] = p;
+    }
 }
 
 void bf_copy(const buffer buff1, const buffer buff2) {
@@ -114,6 +315,17 @@ void bf_copy(const buffer buff1, const buffer buff2) {
     memcpy(buff1.pixels, buff2.pixels, sizeof(pixel) * ((buff1.size < buff2.size) ? buff1.size : buff2.size));
 }
 
+void bf_paste(const buffer buff, const buffer src) {
+    // copy src, laid out as buff is, into buff within its clip rectangle
+    bounds b = clip_bounds(&buff);
+    if (b.x1 <= b.x0) {
+        return;
+    }
+    for (int y = b.y0; y < b.y1; y++) {
+        memcpy(bf_row(&buff, y) + b.x0, bf_row(&src, y) + b.x0, sizeof(pixel) * (b.x1 - b.x0));
+    }
+}
+
 void bf_check_col(buffer buff) {
     for (uint32_t i = 0; i < buff.size; i++) {
         buff.pixels[i] = rgba_to_pixel(pixel_to_rgba(buff.pixels[i]));
@@ -123,65 +335,22 @@ void bf_check_col(buffer buff) {
 void bf_blend(const buffer buff1, const buffer buff2, double alpha) {
     // fade b2 into b1, of same size
     // b1 = alpha*b1 + (1-alpha)*b2
-    struct fb_var_screeninfo *vinfo = get_vinfo();
-    register double r1, g1, b1, a1;
-    register double r2, g2, b2, a2;
-    register pixel p;
-    for (uint32_t i = 0; i < buff1.size; i++) {
-        // separate channels
-        p = buff1.pixels[i];
-        r1 = ((p >> vinfo->red.offset) & 0xFF) * alpha;
-        g1 = ((p >> vinfo->green.offset) & 0xFF) * alpha;
-        b1 = ((p >> vinfo->blue.offset) & 0xFF) * alpha;
-        a1 = ((p >> vinfo->transp.offset) & 0xFF) * alpha;
-        p = buff2.pixels[i];
-        r2 = ((p >> vinfo->red.offset) & 0xFF) * (1.0 - alpha);
-        g2 = ((p >> vinfo->green.offset) & 0xFF) * (1.0 - alpha);
-        b2 = ((p >> vinfo->blue.offset) & 0xFF) * (1.0 - alpha);
-        a2 = ((p >> vinfo->transp.offset) & 0xFF) * (1.0 - alpha);
-        // blend
-        p = ((int)r1 << vinfo->red.offset)      |
-            ((int)g1 << vinfo->green.offset)    |
-            ((int)b1 << vinfo->blue.offset)     |
-            ((int)a1 << vinfo->transp.offset);
-        p += ((int)r2 << vinfo->red.offset)     |
-             ((int)g2 << vinfo->green.offset)   |
-             ((int)b2 << vinfo->blue.offset)    |
-             ((int)a2 << vinfo->transp.offset);
-        // put back
-        buff1.pixels[i] = p;
-    }
+    px_blend_row(buff1.pixels, buff2.pixels, min(buff1.size, buff2.size), alpha);
 }
 
 void bf_shade(const buffer buff, double alpha) {
     // shade buffer into black (alpha < 1.0) or brighter (alpha > 1.0)
     // buff = alpha*buff
-    struct fb_var_screeninfo *vinfo = get_vinfo();
-    register int r, g, b, a;
-    register pixel p;
-    for (uint32_t i = 0; i < buff.size; i++) {
-        // separate channels
-        p = buff.pixels[i];
-        r = (p >> vinfo->red.offset) & 0xFF;
-        g = (p >> vinfo->green.offset) & 0xFF;
-        b = (p >> vinfo->blue.offset) & 0xFF;
-        a = (p >> vinfo->transp.offset) & 0xFF;
-        // blend
-        r = (int)(alpha * r);
-        g = (int)(alpha * g);
-        b = (int)(alpha * b);
-        a = (int)(alpha * a);
-        p = (r << vinfo->red.offset)    |
-            (g << vinfo->green.offset)  |
-            (b << vinfo->blue.offset)   |
-            (a << vinfo->transp.offset);
-        buff.pixels[i] = p;
-    }
+    px_shade_row(buff.pixels, buff.size, alpha);
 }
 
-
 void bf_tinge(const buffer buff, const rgba tc, double alpha) {
     // introduce a tinge of alpha * tc in the active pixels
+    const px_format *f = get_px_format();
+    if (f) {
+        f->tinge_row(buff.pixels, buff.size, tc, alpha);
+        return;
+    }
     rgba c;
     for (uint32_t i = 0; i < buff.size; i++) {
         c = pixel_to_rgba(buff.pixels[i]);
@@ -191,17 +360,21 @@ void bf_tinge(const buffer buff, const rgba tc, double alpha) {
 }
 
 void bf_grayscale(const buffer buff) {
+    const px_format *f = get_px_format();
+    if (f) {
+        f->grayscale_row(buff.pixels, buff.size);
+        return;
+    }
     double y;
     rgba c;
     for (uint32_t i = 0; i < buff.size; i++) {
         // separate channels
         c = pixel_to_rgba(buff.pixels[i]);
-        // linear relative luminance in [0, 1]
+        // relative luminance
         y = 0.2126 * c.r + 0.7152 * c.g + 0.0722 * c.b;
-        // tint
-        c.g = clamp(y * 255);
-        c.g = clamp(y * 255);
-        c.b = clamp(y * 255);
+        c.r = clamp(y);
+        c.g = clamp(y);
+        c.b = clamp(y);
         // put back
         buff.pixels[i] = rgba_to_pixel(c);
     }
@@ -216,153 +389,565 @@ void bf_superpose(const buffer buff1, const buffer buff2) {
     }
 }
 
-void bf_text(buffer buff, char *text, int num_chars, int size, int center, uint32_t x, uint32_t y, int style, rgba c) {
-    // Write text to buff.
-    int w = 0;
-    int pen_x = 0;
-    int width = 0;
-    //int pen_y;
-    int n, error;
-    rgba c_text = c;
-
-    FT_Face face;
-
-    if (style) {
-        face = text_face;
-    } else {
-        face = audio_face;
-    }
-
-    error = FT_Set_Char_Size(
+static FT_Face text_face_sized(int size, int style) {
+    FT_Face face = style ? text_face : audio_face;
+    FT_Set_Char_Size(
             face,               /* handle to face object           */
             0,                  /* char_width in 1/64th of points  */
             size*64,            /* char_height in 1/64th of points */
             DPI,                /* horizontal device resolution    */
             DPI);               /* vertical device resolution      */
+    return face;
+}
 
+static uint32_t text_x(const buffer *buff, FT_Face face, const char *text, int num_chars) {
+    // left edge of the text when centred in buff
+    int width = 0;
+    for (int n = 0; n < num_chars; n++) {
+        // Load glyph image into the slot (erasing previous one).
+        // We do this again in a minute, but they should be cached anyway.
+        if (FT_Load_Char(face, text[n], FT_LOAD_RENDER))
+            continue;  // ignore errors
+        width += face->glyph->advance.x >> 6;
+    }
+    return buff->w / 2 - (uint32_t)(width / 2);
+}
+
+void bf_text(buffer buff, char *text, int num_chars, int size, int center, uint32_t x, uint32_t y, int style, rgba c) {
+    // Write text to buff.
+    if (sdf_on) {
+        text_mask tm;
+        if (!bf_text_mask(buff, text, num_chars, size, center, x, y, style, &tm) && tm.mask) {
+            bf_blit_mask(buff, tm.x, tm.y, tm.mask, tm.w, tm.w, tm.h, rgba_to_pixel(c));
+        }
+        free(tm.mask);
+        return;
+    }
+    int pen_x = 0;
+    pixel p = rgba_to_pixel(c);
+    FT_Face face = text_face_sized(size, style);
     FT_GlyphSlot slot = face->glyph;
 
     // get extent of the rendered text
     if (center) {
-      for (n = 0; n < num_chars; n++) {
-        // Load glyph image into the slot (erasing previous one).
-        // We do this again in a minute, but they should be cached anyway.
-        error = FT_Load_Char(face, text[n], FT_LOAD_RENDER);
-        if (error)
-            continue;  // ignore errors 
-        width += slot->advance.x >> 6;
-      }
-
-      x = buff.w / 2 - (uint32_t)(width / 2);
+        x = text_x(&buff, face, text, num_chars);
     }
 
-    for (n = 0; n < num_chars; n++) {
+    for (int n = 0; n < num_chars; n++) {
         /* load glyph image into the slot (erase previous one) */
-        error = FT_Load_Char(face, text[n], FT_LOAD_RENDER);
-        if (error)
+        if (FT_Load_Char(face, text[n], FT_LOAD_RENDER))
             continue;  /* ignore errors */
 
-        for (uint32_t dx=0; dx < slot->bitmap.width; dx++) {
-            for (uint32_t dy=0; dy < slot->bitmap.rows; dy++) {
-                // use grayscale hinting because text may be any colour
-                w = slot->bitmap.buffer[dy * slot->bitmap.pitch + dx];
-                c_text.r = (uint8_t)(c.r * w >> 8);
-                c_text.g = (uint8_t)(c.g * w >> 8);
-                c_text.b = (uint8_t)(c.b * w >> 8);
-                if (w != 0) {
-                    // render to temp buffer
-                    bf_set_pixel(buff,
-                            x + dx + (uint32_t)pen_x,
-                            y + (uint32_t)(slot->bitmap_top) - dy,
-                            c_text);
+        // use grayscale hinting because text may be any colour
+        bf_blit_mask(buff,
+                (int)x + pen_x,
+                (int)y + slot->bitmap_top,
+                slot->bitmap.buffer,
+                slot->bitmap.pitch,
+                (int)slot->bitmap.width,
+                (int)slot->bitmap.rows,
+                p);
+
+        /* increment pen position */
+        pen_x += slot->advance.x >> 6;
+    }
+}
+
+int bf_text_mask(const buffer buff, char *text, int num_chars, int size, int center, uint32_t x, uint32_t y, int style, text_mask *tm) {
+    // Render text as bf_text places it, but into one coverage mask for
+    // bf_blit_mask, so that it can be drawn later without FreeType.
+    if (sdf_on) {
+        const sdf_font *f = &sdf[style ? 1 : 0];
+        double px = size * DPI / 72.0, left = x;
+        if (center) {
+            left = floor(buff.w / 2.0 - sdf_width(f, text, num_chars, px) / 2);
+        }
+        return sdf_text_mask(f, text, num_chars, px, left, (int)y, tm);
+    }
+    FT_Face face = text_face_sized(size, style);
+    FT_GlyphSlot slot = face->glyph;
+    int pen_x = 0, x0 = INT32_MAX, x1 = INT32_MIN, top = INT32_MIN, bottom = INT32_MAX;
+
+    if (center) {
+        x = text_x(&buff, face, text, num_chars);
+    }
+
+    // extent of the glyph bitmaps
+    for (int n = 0; n < num_chars; n++) {
+        if (FT_Load_Char(face, text[n], FT_LOAD_RENDER))
+            continue;
+        if (slot->bitmap.width && slot->bitmap.rows) {
+            x0 = min(x0, pen_x);
+            x1 = max(x1, pen_x + (int)slot->bitmap.width);
+            top = max(top, slot->bitmap_top);
+            bottom = min(bottom, slot->bitmap_top - (int)slot->bitmap.rows);
+        }
+        pen_x += slot->advance.x >> 6;
+    }
+    tm->mask = NULL;
+    tm->w = tm->h = 0;
+    if (x0 >= x1) {
+        return 0;
+    }
+    tm->x = (int)x + x0;
+    tm->y = (int)y + top;
+    tm->w = x1 - x0;
+    tm->h = top - bottom;
+    tm->mask = calloc((size_t)tm->w * tm->h, 1);
+    if (!tm->mask) {
+        return -1;
+    }
+
+    // composite the glyphs, coverage over coverage
+    pen_x = 0;
+    for (int n = 0; n < num_chars; n++) {
+        if (FT_Load_Char(face, text[n], FT_LOAD_RENDER))
+            continue;
+        for (int r = 0; r < (int)slot->bitmap.rows; r++) {
+            const uint8_t *g = slot->bitmap.buffer + r * slot->bitmap.pitch;
+            uint8_t *m = tm->mask + (top - slot->bitmap_top + r) * tm->w + pen_x - x0;
+            for (int i = 0; i < (int)slot->bitmap.width; i++) {
+                uint32_t a = m[i] + g[i];
+                a -= (m[i] * g[i] + 127) / 255;
+                m[i] = (uint8_t)a;
+            }
+        }
+        pen_x += slot->advance.x >> 6;
+    }
+    return 0;
+}
+
+/* fixed point geometry
+ *
+ * Coordinates of pixel centres are integers; sub-pixel geometry is Q8
+ * (1/256 px), unit vectors and distances are Q16. Nothing here calls libm
+ * per pixel or per step: angles go through a sine table and radii through
+ * an integer square root once per row.
+ */
+
+#define FX_ONE 65536
+#define FX_HALF 32768
+#define SIN_STEPS 4096  // table steps per turn
+
+static int antialias = 1;
+
+// quarter wave, Q16
+static int32_t sin_table[SIN_STEPS / 4 + 1];
+static int sin_table_ready = 0;
+
+static void sin_table_init() {
+    if (sin_table_ready) {
+        return;
+    }
+    for (int i = 0; i <= SIN_STEPS / 4; i++) {
+        sin_table[i] = (int32_t)lround(FX_ONE * sin(2 * M_PI * i / SIN_STEPS));
+    }
+    sin_table_ready = 1;
+}
+
+static int32_t fx_sin_step(int32_t i) {
+    i &= SIN_STEPS - 1;
+    if (i <= SIN_STEPS / 4) {
+        return sin_table[i];
+    } else if (i <= SIN_STEPS / 2) {
+        return sin_table[SIN_STEPS / 2 - i];
+    } else if (i <= 3 * SIN_STEPS / 4) {
+        return -sin_table[i - SIN_STEPS / 2];
+    }
+    return -sin_table[SIN_STEPS - i];
+}
+
+static void fx_sincos(double theta, int32_t *s, int32_t *c) {
+    // theta in degrees, interpolated to 1/16 of a table step
+    int32_t turn = SIN_STEPS * 16;
+    int32_t a = (int32_t)lround(theta * turn / 360) % turn;
+    if (a < 0) {
+        a += turn;
+    }
+    int32_t i = a >> 4;
+    int32_t f = a & 15;
+    int32_t s0 = fx_sin_step(i);
+    int32_t s1 = fx_sin_step(i + 1);
+    int32_t c0 = fx_sin_step(i + SIN_STEPS / 4);
+    int32_t c1 = fx_sin_step(i + 1 + SIN_STEPS / 4);
+    *s = s0 + (((s1 - s0) * f) >> 4);
+    *c = c0 + (((c1 - c0) * f) >> 4);
+}
+
+static uint32_t isqrt64(uint64_t v) {
+    uint64_t r = 0;
+    uint64_t b = (uint64_t)1 << 62;
+    while (b > v) {
+        b >>= 2;
+    }
+    while (b) {
+        if (v >= r + b) {
+            v -= r + b;
+            r = (r >> 1) + b;
+        } else {
+            r >>= 1;
+        }
+        b >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+// floor and ceiling of a / b for b > 0
+static inline int32_t div_floor(int64_t a, int64_t b) {
+    return (int32_t)(a >= 0 ? a / b : -((-a + b - 1) / b));
+}
+
+static inline int32_t div_ceil(int64_t a, int64_t b) {
+    return -div_floor(-a, b);
+}
+
+// The pixels with nx * x + ny * y + c >= 0 (Q16).
+// (nx, ny) is the unit inward normal, so the left side is the distance
+// to the edge in pixels. Soft edges are anti-aliased.
+typedef struct {
+    int32_t nx, ny;
+    int32_t c;
+    int soft;
+} halfplane;
+
+// A region to fill: the intersection of up to four half-planes,
+// optionally with an annulus. Thick lines and arcs are both regions.
+typedef struct {
+    int y0, y1;                 // rows, inclusive
+    int n;
+    halfplane hp[4];
+    int annulus;
+    int32_t cx, cy;             // Q8
+    int32_t r_in, r_out;        // Q8
+} region;
+
+typedef struct {
+    int lo, hi;                 // inclusive, empty if lo > hi
+} interval;
+
+static halfplane hp_through(int32_t nx, int32_t ny, int32_t px, int32_t py, int32_t offset, int soft) {
+    // the half-plane at distance offset (Q16) behind point (px, py) (Q8)
+    halfplane h = {nx, ny, 0, soft};
+    h.c = (int32_t)(-(((int64_t)nx * px + (int64_t)ny * py) >> 8)) + offset;
+    return h;
+}
+
+static void hp_clip_row(const halfplane *h, int y, int32_t t, interval *iv) {
+    // narrow iv to the pixels of row y with distance >= t
+    int64_t d = (int64_t)t - ((int64_t)h->ny * y + h->c);
+    if (h->nx > 0) {
+        iv->lo = max(iv->lo, div_ceil(d, h->nx));
+    } else if (h->nx < 0) {
+        iv->hi = min(iv->hi, div_floor(-d, -(int64_t)h->nx));
+    } else if (d > 0) {
+        iv->hi = iv->lo - 1;
+    }
+}
+
+static int32_t ring_halfwidth(int32_t r, int32_t dy) {
+    // half the chord of a circle of radius r (Q8) at height dy (Q8), or -1
+    if (r <= 0 || r <= abs(dy)) {
+        return -1;
+    }
+    return (int32_t)isqrt64((uint64_t)((int64_t)r * r - (int64_t)dy * dy));
+}
+
+static int ring_row(const region *rg, int y, int32_t r_out, int32_t r_in, interval iv[2]) {
+    // pixels of row y inside r_out and outside r_in
+    int32_t dy = y * 256 - rg->cy;
+    int32_t wo = ring_halfwidth(r_out, dy);
+    if (wo < 0) {
+        return 0;
+    }
+    int32_t wi = ring_halfwidth(r_in, dy);
+    iv[0].lo = div_ceil(rg->cx - wo, 256);
+    iv[1].hi = div_floor(rg->cx + wo, 256);
+    if (wi < 0) {
+        iv[0].hi = iv[1].hi;
+        return 1;
+    }
+    iv[0].hi = div_floor(rg->cx - wi, 256);
+    iv[1].lo = div_ceil(rg->cx + wi, 256);
+    return 2;
+}
+
+static int coverage(const region *rg, int x, int y) {
+    // distance to the nearest soft edge, as coverage in [0, 255]
+    int64_t d = FX_ONE;
+    for (int i = 0; i < rg->n; i++) {
+        if (rg->hp[i].soft) {
+            d = min(d, (int64_t)rg->hp[i].nx * x + (int64_t)rg->hp[i].ny * y + rg->hp[i].c);
+        }
+    }
+    if (rg->annulus) {
+        // first order distance to the circles, (r^2 - rho^2) / 2r
+        int64_t dx = (int64_t)x * 256 - rg->cx;
+        int64_t dy = (int64_t)y * 256 - rg->cy;
+        int64_t rho2 = dx * dx + dy * dy;
+        int64_t ro = rg->r_out;
+        d = min(d, ((ro * ro - rho2) * 128) / ro);
+        if (rg->r_in > 0) {
+            int64_t ri = rg->r_in;
+            d = min(d, ((rho2 - ri * ri) * 128) / ri);
+        }
+    }
+    return (int)max((int64_t)0, min((int64_t)255, (d + FX_HALF) >> 8));
+}
+
+static void fill_region(const buffer *buff, const region *rg, pixel p) {
+    // Fill row by row. Per row each edge bounds an interval of x, which is
+    // relaxed by half a pixel for the pixels touched at all ("outer") and
+    // tightened by half a pixel for the pixels fully covered ("solid").
+    // Solid runs are spans, only the few pixels between get a coverage.
+    bounds b = clip_bounds(buff);
+    int aa = antialias;
+    int32_t t_out = aa ? -FX_HALF : 0;
+    int32_t t_in = aa ? FX_HALF : 0;
+    int32_t grow = aa ? 128 : 0;
+    interval out[2], in[2];
+    int n_out, n_in;
+
+    for (int y = max(rg->y0, b.y0); y <= min(rg->y1, b.y1 - 1); y++) {
+        if (rg->annulus) {
+            n_out = ring_row(rg, y, rg->r_out + grow, rg->r_in - grow, out);
+            n_in = ring_row(rg, y, rg->r_out - grow, rg->r_in + grow, in);
+        } else {
+            out[0].lo = in[0].lo = b.x0;
+            out[0].hi = in[0].hi = b.x1 - 1;
+            n_out = n_in = 1;
+        }
+        for (int i = 0; i < rg->n; i++) {
+            const halfplane *h = &rg->hp[i];
+            for (int j = 0; j < n_out; j++) {
+                hp_clip_row(h, y, h->soft ? t_out : 0, &out[j]);
+            }
+            for (int j = 0; j < n_in; j++) {
+                hp_clip_row(h, y, h->soft ? t_in : 0, &in[j]);
+            }
+        }
+        pixel *row = bf_row(buff, y);
+        for (int j = 0; j < n_out; j++) {
+            int x = max(out[j].lo, b.x0);
+            int x1 = min(out[j].hi, b.x1 - 1);
+            // walk the solid runs inside this interval
+            for (int k = 0; k < n_in; k++) {
+                int s0 = max(in[k].lo, x);
+                int s1 = min(in[k].hi, x1);
+                if (s0 > s1) {
+                    continue;
+                }
+                for (; x < s0; x++) {
+                    int a = coverage(rg, x, y);
+                    if (a) {
+                        row[x] = px_blend(row[x], p, a);
+                    }
+                }
+                for (; x <= s1; x++) {
+                    row[x] = p;
+                }
+            }
+            for (; x <= x1; x++) {
+                int a = coverage(rg, x, y);
+                if (a) {
+                    row[x] = px_blend(row[x], p, a);
                 }
             }
         }
+    }
+}
 
-        /* increment pen position */
-        pen_x += slot->advance.x >> 6;
+static void thick_line(const buffer *buff, int32_t ax, int32_t ay, int32_t bx, int32_t by, int32_t hw, pixel p) {
+    // a line of half-width hw with butt ends, all Q8
+    int64_t dx = bx - ax;
+    int64_t dy = by - ay;
+    int32_t len = (int32_t)isqrt64((uint64_t)(dx * dx + dy * dy));
+    if (len == 0) {
+        return;
     }
+    int32_t ux = (int32_t)((dx * FX_ONE) / len);
+    int32_t uy = (int32_t)((dy * FX_ONE) / len);
+    region rg;
+    rg.y0 = div_floor(min(ay, by) - hw, 256) - 1;
+    rg.y1 = div_ceil(max(ay, by) + hw, 256) + 1;
+    rg.n = 4;
+    rg.hp[0] = hp_through(-uy, ux, ax, ay, hw * 256, 1);
+    rg.hp[1] = hp_through(uy, -ux, ax, ay, hw * 256, 1);
+    rg.hp[2] = hp_through(ux, uy, ax, ay, 0, 1);
+    rg.hp[3] = hp_through(-ux, -uy, bx, by, 0, 1);
+    rg.annulus = 0;
+    fill_region(buff, &rg, p);
+}
+
+void bf_set_antialias(int on) {
+    antialias = on;
 }
 
 void bf_draw_line(const buffer buff, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, rgba c) {
-    // draw a line to the buffer
-    // look at Bresenham's algorithm, or even antialiasing
-    register int x, y, i, n;
-    int dx = x1 - x0;
-    int dy = y1 - y0;
-    int l = dx > dy ? dx : dy;
-    for (i = 0; i <= l; i++) {
-        x = x0 + i * dx / l;
-        y = y0 + i * dy / l;
-        for(n=0; n<10; n++) {
-          bf_set_pixel(buff, x, y+n, c);
+    // one pixel wide line; Wu's algorithm, or Bresenham's without antialiasing
+    int xa = (int)x0, ya = (int)y0, xb = (int)x1, yb = (int)y1;
+    int dx = abs(xb - xa);
+    int dy = abs(yb - ya);
+    pixel p = rgba_to_pixel(c);
+    bounds b = clip_bounds(&buff);
+
+    if (!antialias || dx == 0 || dy == 0 || dx == dy) {
+        int sx = xa < xb ? 1 : -1;
+        int sy = ya < yb ? 1 : -1;
+        int err = dx - dy;
+        for (;;) {
+            px_plot(&buff, &b, xa, ya, p);
+            if (xa == xb && ya == yb) {
+                break;
+            }
+            int e2 = 2 * err;
+            if (e2 > -dy) {
+                err -= dy;
+                xa += sx;
+            }
+            if (e2 < dx) {
+                err += dx;
+                ya += sy;
+            }
+        }
+        return;
+    }
+
+    // step along the major axis, splitting each pixel between the two
+    // nearest minor positions in proportion to the Q16 remainder
+    int steep = dy > dx;
+    if (steep) {
+        int t;
+        t = xa; xa = ya; ya = t;
+        t = xb; xb = yb; yb = t;
+    }
+    if (xa > xb) {
+        int t;
+        t = xa; xa = xb; xb = t;
+        t = ya; ya = yb; yb = t;
+    }
+    int32_t grad = (int32_t)(((int64_t)(yb - ya) * FX_ONE) / (xb - xa));
+    int32_t yf = ya * FX_ONE;
+    for (int x = xa; x <= xb; x++, yf += grad) {
+        int y = yf >> 16;
+        uint32_t a = (yf >> 8) & 0xFF;
+        int px = steep ? y : x;
+        int py = steep ? x : y;
+        int qx = steep ? y + 1 : x;
+        int qy = steep ? x : y + 1;
+        if ((px >= b.x0) && (px < b.x1) && (py >= b.y0) && (py < b.y1)) {
+            pixel *d = bf_row(&buff, py) + px;
+            *d = px_blend(*d, p, 255 - a);
+        }
+        if (a && (qx >= b.x0) && (qx < b.x1) && (qy >= b.y0) && (qy < b.y1)) {
+            pixel *d = bf_row(&buff, qy) + qx;
+            *d = px_blend(*d, p, a);
         }
     }
 }
 
+void bf_draw_thick_line(const buffer buff, int x0, int y0, int x1, int y1, int thickness, rgba c) {
+    // line of the given width, centred on the points
+    if (thickness <= 1) {
+        bf_draw_line(buff, (uint32_t)x0, (uint32_t)y0, (uint32_t)x1, (uint32_t)y1, c);
+        return;
+    }
+    thick_line(&buff, x0 * 256, y0 * 256, x1 * 256, y1 * 256, thickness * 128, rgba_to_pixel(c));
+}
+
 void bf_draw_arc(const buffer buff, int x0, int y0, int radius, double theta0, double theta1, int thickness, rgba c) {
-    // Draw an arc with origin x0, y0, from angle theta0 to theta1
+    // Draw an arc with origin x0, y0, between angles theta0 and theta1
+    // (degrees, anticlockwise), from radius to radius + thickness.
     // NB: x0, y0 are int as they can be negative.
-    int r, x, y, xmin, xmax;
-    rgba c2 = c;
-    c2.r /= 2;
-    c2.g /= 2;
-    c2.b /= 2;
-    // sweep over all x1 < x < x2 and find y
-    // smooth the edges
-    r = radius;
-    xmin = x0 + (int)(r * cos(theta0 * 2 * M_PI / 360));
-    xmax = x0 + (int)(r * cos(theta1 * 2 * M_PI / 360));
-    for (x = (int)xmin; x <= (int)xmax; x++) {
-        y = y0 + sqrt(r * r - (x - x0) * (x - x0));
-        bf_set_pixel(buff, (uint32_t)(x + 1), (uint32_t)(y - 1), c2);
-        bf_set_pixel(buff, (uint32_t)(x - 1), (uint32_t)(y - 1), c2);
-    }
-    r = radius + thickness;
-    xmin = x0 + (int)(r * cos(theta0 * 2 * M_PI / 360));
-    xmax = x0 + (int)(r * cos(theta1 * 2 * M_PI / 360));
-    for (x = (int)xmin; x <= (int)xmax; x++) {
-        y = y0 + sqrt(r * r - (x - x0) * (x - x0));
-        bf_set_pixel(buff, (uint32_t)(x + 1), (uint32_t)(y + 1), c2);
-        bf_set_pixel(buff, (uint32_t)(x - 1), (uint32_t)(y + 1), c2);
-    }
-    // for those x, y, paint the pixels
-    for (r = radius; r <= radius + thickness; r++) {
-        xmin = x0 + (int)(r * cos(theta0 * 2 * M_PI / 360));
-        xmax = x0 + (int)(r * cos(theta1 * 2 * M_PI / 360));
-        for (x = (int)xmin; x <= (int)xmax; x++) {
-            y = y0 + sqrt(r * r - (x - x0) * (x - x0));
-            bf_set_pixel(buff, (uint32_t)x, (uint32_t)y, c);
-            bf_set_pixel(buff, (uint32_t)x, (uint32_t)(y + 1), c);
-            bf_set_pixel(buff, (uint32_t)x, (uint32_t)(y - 1), c);
-        }
+    double t0 = min(theta0, theta1);
+    double t1 = max(theta0, theta1);
+    pixel p = rgba_to_pixel(c);
+    region rg;
+    rg.annulus = 1;
+    rg.cx = x0 * 256;
+    rg.cy = y0 * 256;
+    rg.r_in = radius * 256;
+    rg.r_out = (radius + thickness) * 256;
+    rg.y0 = y0 - radius - thickness - 1;
+    rg.y1 = y0 + radius + thickness + 1;
+    rg.n = 0;
+    if (t1 - t0 >= 360) {
+        fill_region(&buff, &rg, p);
+        return;
+    }
+
+    // A wedge of up to 180 degrees is two half-planes through the origin.
+    // Wider arcs are split in two, with a hard seam between the halves.
+    int32_t sa, ca, sm, cm, sb, cb;
+    int split = (t1 - t0) > 180;
+    double tm = split ? (t0 + t1) / 2 : t1;
+    fx_sincos(t0, &sa, &ca);
+    fx_sincos(tm, &sm, &cm);
+    fx_sincos(t1, &sb, &cb);
+    rg.n = 2;
+    rg.hp[0] = hp_through(-sa, ca, rg.cx, rg.cy, 0, 1);
+    rg.hp[1] = hp_through(sm, -cm, rg.cx, rg.cy, 0, !split);
+    fill_region(&buff, &rg, p);
+    if (split) {
+        halfplane seam = rg.hp[1];
+        rg.hp[0] = seam;
+        rg.hp[0].nx = -seam.nx;
+        rg.hp[0].ny = -seam.ny;
+        rg.hp[0].c = -seam.c - 1;
+        rg.hp[1] = hp_through(sb, -cb, rg.cx, rg.cy, 0, 1);
+        fill_region(&buff, &rg, p);
     }
 }
 
 void bf_draw_ray(const buffer buff, int x0, int y0, int r0, int r1, double theta, int thickness, rgba c) {
     // Draw a ray with origin x0, y0, angle theta, from r0 to r1
     // NB: x0, y0 are int as they can be negative.
-    int r, x, y, dx;
-    rgba c2 = c;
-    c2.r /= 2;
-    c2.g /= 2;
-    c2.b /= 2;
-    // for those x, y, paint the pixels
-    for (r = r0; r <= r1; r++) {
-        for (dx = 0; dx < thickness; dx++) {
-            x = dx + x0 + (int)(r * cos(theta * 2 * M_PI / 360));
-            y = y0 + (int)(r * sin(theta * 2 * M_PI / 360));
-            bf_set_pixel(buff, (uint32_t)x, (uint32_t)(y - 1), c2);
-            bf_set_pixel(buff, (uint32_t)x, (uint32_t)(y + 1), c2);
-        }
+    int32_t s, co;
+    fx_sincos(theta, &s, &co);
+    // Q16 * px >> 8 is Q8
+    int32_t ax = x0 * 256 + (int32_t)(((int64_t)co * r0) >> 8);
+    int32_t ay = y0 * 256 + (int32_t)(((int64_t)s * r0) >> 8);
+    int32_t bx = x0 * 256 + (int32_t)(((int64_t)co * r1) >> 8);
+    int32_t by = y0 * 256 + (int32_t)(((int64_t)s * r1) >> 8);
+    thick_line(&buff, ax, ay, bx, by, max(thickness, 1) * 128, rgba_to_pixel(c));
+}
+
+int bf_ray_sprite(int r0, int r1, double theta, int thickness, sprite *s) {
+    // Render the ray bf_draw_ray draws from 0, 0 as a sprite.
+    // Drawn with its origin on a pixel it covers the same pixels.
+    int32_t sn, co;
+    fx_sincos(theta, &sn, &co);
+    int32_t ax = (int32_t)(((int64_t)co * r0) >> 8);
+    int32_t ay = (int32_t)(((int64_t)sn * r0) >> 8);
+    int32_t bx = (int32_t)(((int64_t)co * r1) >> 8);
+    int32_t by = (int32_t)(((int64_t)sn * r1) >> 8);
+    int32_t hw = max(thickness, 1) * 128;
+    s->x = div_floor(min(ax, bx) - hw, 256) - 1;
+    s->y = div_ceil(max(ay, by) + hw, 256) + 1;
+    buffer tmp;
+    tmp.w = tmp.stride = (uint32_t)(div_ceil(max(ax, bx) + hw, 256) + 2 - s->x);
+    tmp.h = (uint32_t)(s->y + 2 - div_floor(min(ay, by) - hw, 256));
+    tmp.size = tmp.w * tmp.h;
+    tmp.pixels = calloc(tmp.size, sizeof(pixel));
+    uint8_t *mask = malloc(tmp.size);
+    if (!mask || !tmp.pixels) {
+        free(mask);
+        free(tmp.pixels);
+        return -1;
     }
-    for (r = r0; r <= r1; r++) {
-        for (dx = 0; dx < thickness; dx++) {
-            x = dx + x0 + (int)(r * cos(theta * 2 * M_PI / 360));
-            y = y0 + (int)(r * sin(theta * 2 * M_PI / 360));
-            bf_set_pixel(buff, (uint32_t)x, (uint32_t)y, c);
-        }
+    bf_reset_clip(&tmp);
+
+    // white on black, so each channel is the coverage; rows of tmp are
+    // stored top down, as the sprite's are
+    int32_t ox = -s->x * 256;
+    int32_t oy = ((int)tmp.h - 1 - s->y) * 256;
+    thick_line(&tmp, ax + ox, ay + oy, bx + ox, by + oy, hw, 0xFFFFFFFF);
+    for (uint32_t i = 0; i < tmp.size; i++) {
+        mask[i] = (uint8_t)tmp.pixels[i];
     }
+    int err = bf_sprite_pack(s, (int)tmp.w, (int)tmp.h, mask, NULL);
+    free(mask);
+    free(tmp.pixels);
+    return err;
 }
 
 void bf_ray_xy(int x0, int y0, int radius, double theta, int *x, int *y) {
@@ -372,12 +957,12 @@ void bf_ray_xy(int x0, int y0, int radius, double theta, int *x, int *y) {
 
 void bf_xtick(const buffer buff, const axes ax, double x, const rgba c) {
     uint32_t screen_x = ax.screen_w * (x - ax.x_min) / (ax.x_max - ax.x_min) + ax.screen_x;
-    bf_draw_line(buff, screen_x, ax.screen_y, screen_x, ax.screen_y + TICK_SIZE, c);
+    bf_fill_rect(buff, (int)screen_x, (int)ax.screen_y, 1, TICK_SIZE, rgba_to_pixel(c));
 }
 
 void bf_ytick(const buffer buff, const axes ax, double y, const rgba c) {
     uint32_t screen_y = ax.screen_h * (y - ax.y_min) / (ax.y_max - ax.y_min) + ax.screen_y;
-    bf_draw_line(buff, ax.screen_x, screen_y, ax.screen_x + TICK_SIZE, screen_y, c);
+    bf_fill_rect(buff, (int)ax.screen_x, (int)screen_y, TICK_SIZE, 1, rgba_to_pixel(c));
 }
 
 void bf_plot_axes(const buffer buff, const axes ax, const rgba c1, const rgba c2) {
@@ -398,7 +983,7 @@ void bf_plot_axes(const buffer buff, const axes ax, const rgba c1, const rgba c2
 */
 
     axes ax2 = ax;
-    ax2.screen_y = 110;
+    ax2.screen_y = ax.screen_y + ax.base - ax.base / 12;
     for (int n=1; n<10; n++) {
         // powers of 10 Hz
         bf_xtick(buff, ax2, log10(n * 10), c1);
@@ -425,77 +1010,105 @@ void bf_plot_axes(const buffer buff, const axes ax, const rgba c1, const rgba c2
 }
 
 void bf_plot_bars(const buffer buff, const axes ax, const int data[], uint32_t num_points, rgba c) {
-    // plot some data to the buffer
-    register uint32_t x, y, dy;
-    register int n,h;
-    register pixel p, p2;
-    rgba c2 = {0,0,0,0};
-    h = ax.screen_h;// - 100;
-
-    struct fb_var_screeninfo *vinfo = get_vinfo();
+    // Plot data as bars, filled a row at a time from the bottom up.
+    // Each bar's columns and top are worked out once; the colour of each
+    // row, with a black line every BAR_SEGMENT rows, comes from a table.
+    // Bars fill BAR_FILL eighths of their pitch, at least one pixel.
+    bounds b = clip_bounds(&buff);
+    int base = (int)(ax.screen_y + ax.base);
+    int n = (int)num_points;
+    int active[max(n, 1)], x0[max(n, 1)], x1[max(n, 1)], top[max(n, 1)];
+    int num_active = 0, top_max = base;
+    pixel p = rgba_to_pixel(c);
+    pixel p2 = rgba_to_pixel((rgba){0, 0, 0, 0});
 
-    p = (c.r << vinfo->red.offset) |
-        (c.g << vinfo->green.offset) |
-        (c.b << vinfo->blue.offset) |
-        (c.a << vinfo->transp.offset);
+    for (int i = 1; i < n; i++) {
+        double t = ax.screen_h * (10 * log10(data[i]) - ax.y_min) / (ax.y_max - ax.y_min);
+        if (!(t >= 1)) {
+            continue;
+        }
+        int l = (int)((ax.screen_w * i) / num_points + ax.screen_x);
+        int r = (int)((ax.screen_w * (i + 1)) / num_points + ax.screen_x);
+        int w = max(1, ((r - l) * BAR_FILL + 4) / 8);
+        x0[i] = max(l, b.x0);
+        x1[i] = min(l + w, b.x1);
+        top[i] = (int)fmin(t + ax.screen_y, (double)b.y1);
+        if (x0[i] < x1[i] && top[i] > base) {
+            active[num_active++] = i;
+            top_max = max(top_max, top[i]);
+        }
+    }
 
-    p2 = (c2.r << vinfo->red.offset) |
-         (c2.g << vinfo->green.offset) |
-         (c2.b << vinfo->blue.offset) |
-         (c2.a << vinfo->transp.offset);
+    int y0 = max(base, b.y0);
+    int y1 = min(top_max, b.y1);
+    if (y0 >= y1) {
+        return;
+    }
+    pixel lut[y1 - y0];
+    for (int y = y0; y < y1; y++) {
+        lut[y - y0] = (y % BAR_SEGMENT == 0) ? p2 : p;
+    }
 
-    for (uint32_t i=1; i < num_points; i++) {
-        y = (uint32_t)((h) * (10 * log10(data[i]) - ax.y_min) / (ax.y_max - ax.y_min)) + ax.screen_y;
-        if (y > ax.screen_y ) {
-            x = (uint32_t)((ax.screen_w * i) / num_points) + ax.screen_x;
-            // draw peaks
-//            bf_set_pixel(buff, x,   y,   c);
-            // raw pixels for speed
-            for (dy = ax.screen_y+120; dy < y; dy ++) {
-                if ((x < buff.w) && (y < buff.h)) {
-//                    buff.pixels[dy * buff.w + x] = p;
-                    for (n=0; n<10; n++) {
-                      // Draw marks n bars at 10dB intervals
-                      if( dy % 56 == 0) {
-                        buff.pixels[dy * buff.w + x+n] = p2;
-                      }
-                      else {
-                        buff.pixels[dy * buff.w + x+n] = p;
-                      }
-                    }
-                }
+    for (int y = y0; y < y1 && num_active; y++) {
+        pixel *row = bf_row(&buff, y);
+        pixel q = lut[y - y0];
+        int k = 0;
+        for (int j = 0; j < num_active; j++) {
+            int i = active[j];
+            if (top[i] <= y) {
+                // this bar has ended
+                continue;
             }
+            for (int x = x0[i]; x < x1[i]; x++) {
+                row[x] = q;
+            }
+            active[k++] = i;
         }
+        num_active = k;
     }
 }
 
 void bf_plot_line(const buffer buff, const axes ax, const double data[], uint32_t num_points, rgba c) {
     // plot some data to the buffer
-    register uint32_t x, y;
+    int x, y;
+    pixel p = rgba_to_pixel(c);
+    bounds b = clip_bounds(&buff);
     for (uint32_t i=1; i < num_points; i++) {
-        x = (uint32_t)((ax.screen_w * i) / num_points) + ax.screen_x;
-        y = (uint32_t)((ax.screen_h * (data[i] - ax.y_min)) / (ax.y_max - ax.y_min)) + ax.screen_y;
-        bf_set_pixel(buff, x,   y,   c);
+        x = (int)((ax.screen_w * i) / num_points) + (int)ax.screen_x;
+        y = (int)((ax.screen_h * (data[i] - ax.y_min)) / (ax.y_max - ax.y_min)) + (int)ax.screen_y;
+        px_plot(&buff, &b, x, y, p);
     }
 }
 
-void bf_blit(buffer buff) {
-    // blit buffer pixels to the framebuffer
-    // relies on pixel format being the same
-    fb_blit(buff.pixels, buff.w, buff.h);
-}
-
-void bf_render(buffer buff) {
-    // push buffer pixels to the framebuffer
-    //rgba c;
-    pixel p;
-    for (uint32_t x = 0; x < buff.w; x++) {
-        for (uint32_t y = 0; y < buff.h; y++) {
-            //DEBUG("x: %d, y: %d, i: %d, size: %d \n", x, y, i, buff.size);
-            p = buff.pixels[y * buff.w + x];
-            //c = pixel_to_rgba(buff.pixels[y * buff.w + x]);
-            //fb_set_pixel(x, y, c);
-            fb_set_raw_pixel(x, y, p);
+void bf_plot_scope(const buffer buff, const axes ax, const double env[], uint32_t num_cols, rgba c) {
+    // Plot a decimated waveform, the least and greatest sample of each
+    // column in env, as one vertical span per column. Each span reaches
+    // the last one, so the trace is connected however steep it is.
+    pixel p = rgba_to_pixel(c);
+    bounds b = clip_bounds(&buff);
+    double k = ax.screen_h / (ax.y_max - ax.y_min);
+    int y_lo = 0, y_hi = 0;
+    for (uint32_t i = 0; i < num_cols; i++) {
+        int lo = (int)floor(k * (env[2 * i] - ax.y_min)) + (int)ax.screen_y;
+        int hi = (int)floor(k * (env[2 * i + 1] - ax.y_min)) + (int)ax.screen_y;
+        int y0 = i ? min(lo, y_hi) : lo;
+        int y1 = i ? max(hi, y_lo) : hi;
+        y_lo = lo;
+        y_hi = hi;
+        int x = (int)(ax.screen_x + i);
+        if (x < b.x0 || x >= b.x1) {
+            continue;
+        }
+        y0 = max(y0, b.y0);
+        y1 = min(y1, b.y1 - 1);
+        for (int y = y0; y <= y1; y++) {
+            bf_row(&buff, y)[x] = p;
         }
     }
 }
+
+void bf_blit(buffer buff) {
+    // blit buffer pixels to the framebuffer,
+    // which rotates and converts them as needed
+    fb_blit(buff.pixels, buff.w, buff.h, buff.stride);
+}
@@ -9,32 +9,55 @@
 #pragma once
 
 #include <inttypes.h>
+#include <stddef.h>
 
 #include "framebuffer.h"
 
-#define FRAMEBUFFER_WIDTH 800
-#define FRAMEBUFFER_HEIGHT 480
 #define DPI 231
-#define TICK_SIZE 3
+#define TICK_SIZE 13
+#define BAR_SEGMENT 56  // rows between the lines across the bars
+#define BAR_FILL 3      // eighths of the bar pitch that a bar fills
 
 
-typedef uint32_t rgb666;
+// an abstract rectangle
+typedef struct {
+    uint32_t x;
+    uint32_t y;
+    uint32_t w;
+    uint32_t h;
+} rect;
 
 // a screen buffer, local format
 typedef struct {
     uint32_t h;
     uint32_t w;
+    uint32_t stride;    // pixels from one row to the next
     uint32_t size;
     pixel *pixels;
+    rect clip;      // primitives only touch pixels inside this rectangle
 } buffer;
 
-// an abstract rectangle
+// text rendered to a coverage mask, rows running down from y
 typedef struct {
-    uint32_t x;
-    uint32_t y;
-    uint32_t w;
-    uint32_t h;
-} rect;
+    int x;
+    int y;
+    int w;
+    int h;
+    uint8_t *mask;
+} text_mask;
+
+// a picture drawn relative to an origin, kept as one span of pixels
+// per row: row r is y - r, from x + row[r].x for row[r].w pixels, and
+// its pixels start at row[r].at. Coverage always; colours too, or it
+// takes the colour it is drawn with.
+typedef struct {
+    int x;
+    int y;
+    int h;
+    struct { int x, w; size_t at; } *row;
+    uint8_t *mask;
+    pixel *image;
+} sprite;
 
 typedef struct {
     // screen coordinates
@@ -42,6 +65,7 @@ typedef struct {
     uint32_t screen_y;
     uint32_t screen_w;
     uint32_t screen_h;
+    uint32_t base;      // rows kept below the bars for the ticks
     // plot data coordinates
     double x_min;
     double x_max;
@@ -52,23 +76,28 @@ typedef struct {
 
 uint8_t clamp(double c);
 
-rgb666 rgba_to_rgb666(rgba c);
-
-rgba rgb666_to_rgba(rgb666 c);
-
 rgba tinge_color(rgba c1, rgba c2, double alpha);
 
 void freetype_init(char *text_font, char*audio_font);
+int freetype_sdf(const char *text_font, const char *audio_font, const char *cache_dir);
 void freetype_cleanup();
 
 void bf_init(buffer *buff);
 void bf_free_pixels(buffer *buff);
 
+void bf_set_clip(buffer *buff, rect r);
+void bf_reset_clip(buffer *buff);
+
 void bf_set_pixel(buffer buff, uint32_t x, uint32_t y, rgba c);
 
-void bf_blit(buffer buff);
+// raster primitives
+// colours are packed once by the caller (rgba_to_pixel) and the clip
+// rectangle is applied once per primitive, not per pixel.
+void bf_hspan(const buffer buff, int x, int y, int w, pixel p);
+void bf_fill_rect(const buffer buff, int x, int y, int w, int h, pixel p);
+void bf_blit_mask(const buffer buff, int x, int y, const uint8_t *mask, int pitch, int w, int h, pixel p);
 
-void bf_render(buffer buff);
+void bf_blit(buffer buff);
 
 void bf_clear(const buffer buff);
 
@@ -76,6 +105,8 @@ void bf_fill(const buffer buff, const rgba c);
 
 void bf_copy(const buffer buff1, const buffer buff2);
 
+void bf_paste(const buffer buff, const buffer src);
+
 void bf_check_col(buffer buff);
 
 void bf_blend(const buffer buff1, const buffer buff2, double alpha);
@@ -89,9 +120,22 @@ void bf_superpose(const buffer buff1, const buffer buff2);
 void bf_grayscale(const buffer buff);
 
 void bf_text(buffer buff, char *text, int num_chars, int size, int center, uint32_t x, uint32_t y, int style, rgba c);
+int bf_text_mask(const buffer buff, char *text, int num_chars, int size, int center, uint32_t x, uint32_t y, int style, text_mask *tm);
+
+void bf_blit_sprite(const buffer buff, int x, int y, const sprite *s, pixel p);
+
+int bf_sprite_pack(sprite *s, int w, int h, const uint8_t *mask, const pixel *image);
+
+void bf_sprite_free(sprite *s);
+
+int bf_ray_sprite(int r0, int r1, double theta, int thickness, sprite *s);
+
+void bf_set_antialias(int on);
 
 void bf_draw_line(const buffer buff, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, rgba c);
 
+void bf_draw_thick_line(const buffer buff, int x0, int y0, int x1, int y1, int thickness, rgba c);
+
 void bf_draw_arc(const buffer buff, int x0, int y0, int radius, double theta0, double theta1, int thickness, rgba c);
 
 void bf_draw_ray(const buffer buff, int x0, int y0, int r0, int r1, double theta, int thickness, rgba c);
@@ -105,3 +149,4 @@ void bf_plot_axes(const buffer buff, const axes ax, const rgba c1, const rgba c2
 
 void bf_plot_bars(const buffer buff, const axes ax, const int data[], uint32_t num_points, rgba c);
 void bf_plot_line(const buffer buff, const axes ax, const double data[], uint32_t num_points, rgba c);
+void bf_plot_scope(const buffer buff, const axes ax, const double env[], uint32_t num_cols, rgba c);
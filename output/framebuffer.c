@@ -15,94 +15,442 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <linux/fb.h>
-#include <fcntl.h> 
-#include <sys/ioctl.h>
-#include <sys/mman.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <string.h>
 #include <time.h>
 #include <math.h>
 
 #include "debug.h"
 #include "framebuffer.h"
-
-#include <unistd.h>
+#include "backend.h"
+#include "backlight.h"
+#include "pixops.h"
+#include "util.h"
 
 
 struct fb_fix_screeninfo finfo;
 struct fb_var_screeninfo vinfo;
+// The pixel format of buffers. It is the screen's own when that is
+// 32 bpp with 8 bit channels, otherwise XRGB8888 which fb_blit converts.
+struct fb_var_screeninfo pinfo;
 
 uint8_t *fbp;
-int fd;
+static const fb_backend *backend;
+
+// ordered dither, channel by threshold by 8 bit value, shifted into place
+static int native;
+static uint32_t dither_lut[3][16][256];
+
+static struct {
+    int rotate;         // quarter turns clockwise
+    int flip_x;
+    int flip_y;
+} orientation;
+
+
+static void make_dither_lut(int dither) {
+    // 4x4 Bayer matrix; without dither every threshold is one half
+    static const uint8_t bayer[16] = {0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5};
+    struct fb_bitfield *f[3] = {&vinfo.red, &vinfo.green, &vinfo.blue};
+    for (int c = 0; c < 3; c++) {
+        uint32_t levels = (1u << f[c]->length) - 1;
+        for (int k = 0; k < 16; k++) {
+            uint32_t t = dither ? (bayer[k] * 2 + 1) * 255 / 32 : 127;
+            for (uint32_t v = 0; v < 256; v++) {
+                uint32_t q = (v * levels + t) / 255;
+                dither_lut[c][k][v] = (q > levels ? levels : q) << f[c]->offset;
+            }
+        }
+    }
+}
+
+// Storing runs of buffer pixels on the screen. Each takes n pixels from
+// src and stores them step bytes apart from dst; sx, sy is the screen
+// position of the first and dsx, dsy the step, for the dither. One is
+// picked by fb_setup for the screen's format: a copy when it is the
+// buffer's own, fixed shifts for RGB565 and RGB888, and the dither
+// tables for anything else.
+typedef void (*store_fn)(uint8_t *dst, ptrdiff_t step, const pixel *src, uint32_t n,
+        int sx, int sy, int dsx, int dsy);
+
+static void store_native(uint8_t *dst, ptrdiff_t step, const pixel *src, uint32_t n,
+        int sx, int sy, int dsx, int dsy) {
+    (void)sx; (void)sy; (void)dsx; (void)dsy;
+    for (uint32_t i = 0; i < n; i++, dst += step) {
+        *((uint32_t *)dst) = src[i];
+    }
+}
+
+static inline uint16_t xrgb_to_rgb565(pixel p) {
+    // each channel rounded to nearest, as the dither tables do without dither
+    uint32_t r = (((p >> 16) & 0xFF) * 249 + 1014) >> 11;
+    uint32_t g = (((p >> 8) & 0xFF) * 253 + 505) >> 10;
+    uint32_t b = ((p & 0xFF) * 249 + 1014) >> 11;
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void store_rgb565(uint8_t *dst, ptrdiff_t step, const pixel *src, uint32_t n,
+        int sx, int sy, int dsx, int dsy) {
+    (void)sx; (void)sy; (void)dsx; (void)dsy;
+    if (step == 2) {
+        // a straight row, which the compiler can vectorise
+        uint16_t *d = (uint16_t *)dst;
+        for (uint32_t i = 0; i < n; i++) {
+            d[i] = xrgb_to_rgb565(src[i]);
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++, dst += step) {
+        *((uint16_t *)dst) = xrgb_to_rgb565(src[i]);
+    }
+}
+
+static void store_rgb888(uint8_t *dst, ptrdiff_t step, const pixel *src, uint32_t n,
+        int sx, int sy, int dsx, int dsy) {
+    (void)sx; (void)sy; (void)dsx; (void)dsy;
+    for (uint32_t i = 0; i < n; i++, dst += step) {
+        pixel p = src[i];
+        dst[0] = (uint8_t)p;
+        dst[1] = (uint8_t)(p >> 8);
+        dst[2] = (uint8_t)(p >> 16);
+    }
+}
+
+#define STORE_LUT(bits, STORE)                                                  \
+    static void store_lut##bits(uint8_t *dst, ptrdiff_t step, const pixel *src, \
+            uint32_t n, int sx, int sy, int dsx, int dsy) {                     \
+        for (uint32_t i = 0; i < n; i++, dst += step, sx += dsx, sy += dsy) {   \
+            pixel p = src[i];                                                   \
+            uint32_t k = ((sy & 3) << 2) | (sx & 3);                            \
+            uint32_t q = dither_lut[0][k][(p >> 16) & 0xFF] |                   \
+                dither_lut[1][k][(p >> 8) & 0xFF] |                             \
+                dither_lut[2][k][p & 0xFF];                                     \
+            STORE;                                                              \
+        }                                                                       \
+    }
+
+STORE_LUT(16, *((uint16_t *)dst) = (uint16_t)q)
+STORE_LUT(24, dst[0] = (uint8_t)q; dst[1] = (uint8_t)(q >> 8); dst[2] = (uint8_t)(q >> 16))
+STORE_LUT(32, *((uint32_t *)dst) = q)
+
+static store_fn store_run = store_native;
+
+static int has_fields(const struct fb_var_screeninfo *v, uint32_t bpp,
+        uint32_t r, uint32_t rl, uint32_t g, uint32_t gl, uint32_t b, uint32_t bl) {
+    return v->bits_per_pixel == bpp &&
+        v->red.offset == r && v->red.length == rl &&
+        v->green.offset == g && v->green.length == gl &&
+        v->blue.offset == b && v->blue.length == bl;
+}
+
+static store_fn pick_store(int dither) {
+    if (native) {
+        return store_native;
+    }
+    if (!dither && has_fields(&vinfo, 16, 11, 5, 5, 6, 0, 5)) {
+        return store_rgb565;
+    }
+    if (has_fields(&vinfo, 24, 16, 8, 8, 8, 0, 8)) {
+        return store_rgb888;
+    }
+    switch (vinfo.bits_per_pixel) {
+    case 16:
+        return store_lut16;
+    case 24:
+        return store_lut24;
+    default:
+        return store_lut32;
+    }
+}
+
+// Buffer pixel formats. The common layouts pack and unpack with constant
+// shifts; the generic one reads them from pinfo.
+#define PIXEL_FORMAT(name, R, G, B, A)                                          \
+    static pixel pack_##name(rgba c) {                                          \
+        return (c.r << R) | (c.g << G) | (c.b << B) | (c.a << A);               \
+    }                                                                           \
+    static rgba unpack_##name(pixel p) {                                        \
+        rgba c = {(p >> R) & 0xFF, (p >> G) & 0xFF, (p >> B) & 0xFF, (p >> A) & 0xFF}; \
+        return c;                                                               \
+    }
+
+PIXEL_FORMAT(xrgb8888, 16, 8, 0, 24)
+PIXEL_FORMAT(xbgr8888, 0, 8, 16, 24)
+
+static pixel pack_generic(rgba c) {
+    uint32_t pixel = (c.r << pinfo.red.offset)|
+        (c.g << pinfo.green.offset) |
+        (c.b << pinfo.blue.offset) |
+        (pinfo.transp.length ? c.a << pinfo.transp.offset : 0);
+    return pixel;
+}
+
+static rgba unpack_generic(pixel p) {
+    rgba c;
+    c.r = (p >> pinfo.red.offset) & 0xFF;
+    c.g = (p >> pinfo.green.offset) & 0xFF;
+    c.b = (p >> pinfo.blue.offset) & 0xFF;
+    c.a = pinfo.transp.length ? (p >> pinfo.transp.offset) & 0xFF : 0;
+    return c;
+}
+
+static pixel (*pack)(rgba c) = pack_generic;
+static rgba (*unpack)(pixel p) = unpack_generic;
+static const px_format *format;
 
+int fb_setup(const fb_options *o) {
+    // map the screen and work out how buffers are converted for it
+    backend = o->headless ? &fb_backend_headless : &fb_backend_fbdev;
+    if (backend->open(o, &vinfo, &finfo, &fbp)) {
+        return -1;
+    }
+    if (vinfo.bits_per_pixel != 16 && vinfo.bits_per_pixel != 24 && vinfo.bits_per_pixel != 32) {
+        // the stores and raw pixel access step whole 2, 3 or 4 byte pixels
+        fprintf(stderr, "%s: %u bpp screens are not supported, only 16, 24 and 32\n",
+                backend->name, vinfo.bits_per_pixel);
+        backend->close(fbp);
+        fbp = NULL;
+        return -1;
+    }
+
+    native = (vinfo.bits_per_pixel == 32) &&
+        (vinfo.red.length == 8) && (vinfo.green.length == 8) && (vinfo.blue.length == 8);
+    pinfo = vinfo;
+    if (!native) {
+        pinfo.bits_per_pixel = 32;
+        pinfo.red.offset = 16;
+        pinfo.green.offset = 8;
+        pinfo.blue.offset = 0;
+        pinfo.transp.offset = 24;
+        pinfo.red.length = pinfo.green.length = pinfo.blue.length = 8;
+        pinfo.transp.length = 0;
+        make_dither_lut(o->dither);
+    }
 
-void fb_setup() {
-    vinfo.grayscale = 0;
-    vinfo.bits_per_pixel = 32;
-    fd = open("/dev/fb0", O_RDWR);
-    ioctl(fd, FBIOGET_VSCREENINFO, &vinfo);
-    ioctl(fd, FBIOGET_FSCREENINFO, &finfo);
-    // this pointer is global
-    fbp = mmap(0, vinfo.yres * finfo.line_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // kernels for the formats
+    store_run = pick_store(o->dither);
+    format = px_format_for(&pinfo);
+    // alpha goes in the top byte, or the unused top byte if there is no
+    // alpha field, so the constant packs cover both
+    int top = pinfo.transp.length == 0 || pinfo.transp.offset == 24;
+    pack = pack_generic;
+    unpack = unpack_generic;
+    if (format && has_fields(&pinfo, 32, 16, 8, 8, 8, 0, 8) && top) {
+        pack = pack_xrgb8888;
+        unpack = unpack_xrgb8888;
+    } else if (format && has_fields(&pinfo, 32, 0, 8, 8, 8, 16, 8) && top) {
+        pack = pack_xbgr8888;
+        unpack = unpack_xbgr8888;
+    }
+    debug("%s: %dx%d, %d bpp, rgb %d%d%d, buffers %s\n", backend->name, vinfo.xres, vinfo.yres,
+            vinfo.bits_per_pixel, vinfo.red.length, vinfo.green.length, vinfo.blue.length,
+            format ? format->name : "unknown");
+    return 0;
 }
 
 int fb_cleanup() {
     fb_clear();
-    return munmap(fbp, vinfo.yres * finfo.line_length);
+    backend->close(fbp);
+    fbp = NULL;
+    return 0;
 }
 
 struct fb_var_screeninfo *get_vinfo() {
-    return &vinfo;
+    // the format of buffer pixels, see pinfo
+    return &pinfo;
 };
 
+const px_format *get_px_format() {
+    // kernels for the buffer format, NULL before fb_setup
+    return format;
+}
+
 uint32_t rgba_to_pixel(rgba c) {
-    uint32_t pixel = (c.r << vinfo.red.offset)|
-        (c.g << vinfo.green.offset) |
-        (c.b << vinfo.blue.offset) |
-        (c.a << vinfo.transp.offset);
-    return pixel;
+    return pack(c);
 }
 
 rgba pixel_to_rgba(pixel p) {
-    rgba c;
-    c.r = (p >> vinfo.red.offset) & 0xFF;
-    c.g = (p >> vinfo.green.offset) & 0xFF;
-    c.b = (p >> vinfo.blue.offset) & 0xFF;
-    c.a = (p >> vinfo.transp.offset) & 0xFF;
-    return c;
+    return unpack(p);
+}
+
+uint32_t fb_pack(rgba c) {
+    // rgba to the screen's own format
+    uint32_t p = 0;
+    p |= (c.r >> (8 - vinfo.red.length)) << vinfo.red.offset;
+    p |= (c.g >> (8 - vinfo.green.length)) << vinfo.green.offset;
+    p |= (c.b >> (8 - vinfo.blue.length)) << vinfo.blue.offset;
+    return p;
 }
 
 uint32_t fb_get_raw_pixel(uint32_t x, uint32_t y) {
-    uint32_t location = x * (vinfo.bits_per_pixel / 8) + (vinfo.yres - y - 1) * finfo.line_length;
-    return *((uint32_t*) (fbp + location));
+    // screen coordinates, y down
+    uint8_t *loc = fbp + x * (vinfo.bits_per_pixel / 8) + y * finfo.line_length;
+    switch (vinfo.bits_per_pixel) {
+    case 16:
+        return *((uint16_t*) loc);
+    case 24:
+        return loc[0] | (loc[1] << 8) | (loc[2] << 16);
+    default:
+        return *((uint32_t*) loc);
+    }
 }
 
 void fb_set_raw_pixel(uint32_t x, uint32_t y, uint32_t pixel) {
-    uint32_t location = x * (vinfo.bits_per_pixel / 8) + (vinfo.yres - y - 1) * finfo.line_length;
-    *((uint32_t*) (fbp + location)) = pixel;
+    // screen coordinates, y down
+    uint8_t *loc = fbp + x * (vinfo.bits_per_pixel / 8) + y * finfo.line_length;
+    switch (vinfo.bits_per_pixel) {
+    case 16:
+        *((uint16_t*) loc) = (uint16_t)pixel;
+        break;
+    case 24:
+        loc[0] = (uint8_t)pixel;
+        loc[1] = (uint8_t)(pixel >> 8);
+        loc[2] = (uint8_t)(pixel >> 16);
+        break;
+    default:
+        *((uint32_t*) loc) = pixel;
+    }
 }
 
 void fb_set_pixel(uint32_t x, uint32_t y, rgba c) {
-    fb_set_raw_pixel(x, y, rgba_to_pixel(c));
+    fb_set_raw_pixel(x, y, fb_pack(c));
+}
+
+void fb_set_orientation(int rotate, int flip_x, int flip_y) {
+    // rotate is clockwise in degrees; flips apply before rotating
+    orientation.rotate = ((rotate / 90) % 4 + 4) % 4;
+    orientation.flip_x = flip_x;
+    orientation.flip_y = flip_y;
 }
 
-void fb_blit(uint32_t *pixels, uint32_t line_length, uint32_t lines) {
-    // Copy whole lines at a time.
-    // Can be further optimised if *pixels is same size
-    // as fb, to copy in one go.
-    if ((finfo.line_length == line_length) && (vinfo.yres >= lines)) {
-        // may be upside down here!
-        memcpy(fbp, pixels, sizeof(uint32_t) * finfo.line_length * lines);
+static void map_point(int x, int y, int w, int h, int *sx, int *sy) {
+    // buffer pixel to screen pixel, both with y down
+    if (orientation.flip_x) {
+        x = w - 1 - x;
+    }
+    if (orientation.flip_y) {
+        y = h - 1 - y;
+    }
+    switch (orientation.rotate) {
+    case 1:
+        *sx = h - 1 - y;
+        *sy = x;
+        break;
+    case 2:
+        *sx = w - 1 - x;
+        *sy = h - 1 - y;
+        break;
+    case 3:
+        *sx = y;
+        *sy = w - 1 - x;
+        break;
+    default:
+        *sx = x;
+        *sy = y;
+    }
+}
+
+static void axis_range(int o, int step, int n, int limit, int *lo, int *hi) {
+    // the i in [0, n) with 0 <= o + i * step < limit, for step = 1, -1 or 0
+    if (step > 0) {
+        *lo = max(0, -o);
+        *hi = min(n, limit - o);
+    } else if (step < 0) {
+        *lo = max(0, o - limit + 1);
+        *hi = min(n, o + 1);
     } else {
-        uint32_t location, pixels_loc;
-        for (uint32_t y=0; y<lines; y++) {
-            location = (vinfo.yres - y - 1) * finfo.line_length;
-            pixels_loc = y * line_length;
-            memcpy(fbp + location, pixels + pixels_loc, sizeof(uint32_t) * line_length);
+        *lo = 0;
+        *hi = (o >= 0 && o < limit) ? n : 0;
+    }
+}
+
+static void blit(uint32_t *pixels, uint32_t w, uint32_t h, uint32_t stride) {
+    // Copy a w x h buffer (rows top to bottom, stride pixels apart) to the screen in its
+    // orientation. The buffer origin and the screen steps for one pixel
+    // right and one row down are found once, then the copy is whole
+    // rows when rows stay rows, or cache-sized tiles when rotated.
+    const int tile = 32;
+    int ox, oy, x1, y1, x2, y2;
+    map_point(0, 0, (int)w, (int)h, &ox, &oy);
+    map_point(1, 0, (int)w, (int)h, &x1, &y1);
+    map_point(0, 1, (int)w, (int)h, &x2, &y2);
+    int xdx = x1 - ox, xdy = y1 - oy;   // screen step per buffer column
+    int ydx = x2 - ox, ydy = y2 - oy;   // screen step per buffer row
+
+    // the part of the buffer that lands on the screen
+    int bx0, bx1, by0, by1;
+    if (xdx) {
+        axis_range(ox, xdx, (int)w, (int)vinfo.xres, &bx0, &bx1);
+        axis_range(oy, ydy, (int)h, (int)vinfo.yres, &by0, &by1);
+    } else {
+        axis_range(oy, xdy, (int)w, (int)vinfo.yres, &bx0, &bx1);
+        axis_range(ox, ydx, (int)h, (int)vinfo.xres, &by0, &by1);
+    }
+    if (bx0 >= bx1 || by0 >= by1) {
+        return;
+    }
+
+    int bpp = (int)vinfo.bits_per_pixel / 8;
+    ptrdiff_t line = finfo.line_length;
+    ptrdiff_t step_x = xdx * bpp + xdy * line;
+    ptrdiff_t step_y = ydx * bpp + ydy * line;
+    uint8_t *origin = fbp + ox * bpp + oy * line;
+
+    if (native && step_x == bpp) {
+        // same orientation and format: one copy, or one per row
+        uint32_t n = (uint32_t)(bx1 - bx0);
+        if (step_y == line && n == w && (ptrdiff_t)(stride * sizeof(pixel)) == line) {
+            memcpy(origin + by0 * line, pixels + by0 * stride, line * (by1 - by0));
+            return;
+        }
+        for (int y = by0; y < by1; y++) {
+            memcpy(origin + y * step_y + bx0 * step_x, pixels + y * stride + bx0, sizeof(pixel) * n);
+        }
+        return;
+    }
+
+    if (xdx) {
+        // rows stay rows, maybe mirrored or converted
+        for (int y = by0; y < by1; y++) {
+            store_run(origin + y * step_y + bx0 * step_x, step_x, pixels + y * stride + bx0,
+                    (uint32_t)(bx1 - bx0),
+                    ox + bx0 * xdx + y * ydx, oy + y * ydy, xdx, 0);
         }
+        return;
+    }
+
+    // rows become columns: go tile by tile so that both the reads and
+    // the writes stay within a few cache lines
+    for (int ty = by0; ty < by1; ty += tile) {
+        for (int tx = bx0; tx < bx1; tx += tile) {
+            uint32_t n = (uint32_t)min(tile, bx1 - tx);
+            for (int y = ty; y < min(ty + tile, by1); y++) {
+                store_run(origin + y * step_y + tx * step_x, step_x, pixels + y * stride + tx, n,
+                        ox + y * ydx, oy + tx * xdy, 0, xdy);
+            }
+        }
+    }
+}
+
+void fb_buffer_size(uint32_t *w, uint32_t *h, uint32_t *stride) {
+    // The buffer that fills the screen in its orientation. When rows are
+    // copied straight, buffer rows are spaced like the screen's so that
+    // the whole frame is a single copy.
+    *w = orientation.rotate & 1 ? vinfo.yres : vinfo.xres;
+    *h = orientation.rotate & 1 ? vinfo.xres : vinfo.yres;
+    *stride = *w;
+    if (native && !orientation.rotate && !orientation.flip_x && !orientation.flip_y &&
+            finfo.line_length % sizeof(pixel) == 0) {
+        *stride = max(*w, finfo.line_length / (uint32_t)sizeof(pixel));
     }
 }
 
+void fb_blit(uint32_t *pixels, uint32_t w, uint32_t h, uint32_t stride) {
+    blit(pixels, w, h, stride);
+    backend->present(fbp);
+}
+
 void fb_fill_rect(uint32_t x, uint32_t y, uint32_t X, uint32_t Y, rgba c) {
     for (uint32_t i = 0; i < X; i++) {
         for (uint32_t j = 0; j < Y; j++) {
@@ -116,7 +464,16 @@ void fb_clear() {
 }
 
 void fb_vsync() {
-    ioctl(fd, FBIO_WAITFORVSYNC, 0);
+    backend->wait();
+}
+
+int fb_blank(int blank) {
+    // turn the panel off or back on: by the driver if it can,
+    // otherwise by the backlight
+    if (!backend->blank || !backend->blank(blank)) {
+        return 0;
+    }
+    return bl_power(!blank);
 }
 
 void fb_draw_line_fb(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, rgba c) {
@@ -14,30 +14,51 @@ typedef struct  {
     uint32_t a;
 } rgba;
 
-typedef struct {
-    uint32_t h;
-    uint32_t w;
-    int *pixels; // fix this
-} image;
 
+// what a headless screen does with each finished frame
+enum fb_dump {
+    FB_DUMP_NONE,
+    FB_DUMP_RAW,
+    FB_DUMP_PPM,
+    FB_DUMP_CHECKSUM,
+};
+
+typedef struct {
+    int headless;           // keep the screen in memory, not on a device
+    const char *device;     // framebuffer device, e.g. /dev/fb0
+    uint32_t width, height; // headless screen size
+    int bpp;                // depth to ask for, 0 for the current or 32
+    int dither;
+    int dump;               // enum fb_dump, headless only
+    const char *dump_path;  // file, or PPM name prefix; stdout if empty
+} fb_options;
 
-void fb_setup();
+int fb_setup(const fb_options *o);
 
 int fb_cleanup();
 
 struct fb_var_screeninfo *get_vinfo();
 
+typedef struct px_format px_format;
+const px_format *get_px_format();
+
 uint32_t rgba_to_pixel(rgba c);
 
 rgba pixel_to_rgba(pixel p);
 
+uint32_t fb_pack(rgba c);
+
 uint32_t fb_get_raw_pixel(uint32_t x, uint32_t y);
 
 void fb_set_raw_pixel(uint32_t x, uint32_t y, uint32_t pixel);
 
 void fb_set_pixel(uint32_t x, uint32_t y, rgba c);
 
-void fb_blit(uint32_t *pixels, uint32_t line_length, uint32_t lines);
+void fb_set_orientation(int rotate, int flip_x, int flip_y);
+
+void fb_buffer_size(uint32_t *w, uint32_t *h, uint32_t *stride);
+
+void fb_blit(uint32_t *pixels, uint32_t w, uint32_t h, uint32_t stride);
 
 void fb_fill_rect(uint32_t x, uint32_t y, uint32_t X, uint32_t Y, rgba c);
 
@@ -45,4 +66,6 @@ void fb_clear();
 
 void fb_vsync();
 
+int fb_blank(int blank);
+
 void fb_draw_line(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, rgba c);
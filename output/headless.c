@@ -0,0 +1,156 @@
+// headless output backend, part of spectrum.
+//
+// The screen is a block of memory with the layout a framebuffer driver
+// would report. Each finished frame can be dumped as raw screen bytes
+// (all frames in one file), as numbered PPM images, or as one checksum
+// line per frame for comparing renders between builds.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <linux/fb.h>
+
+#include "backend.h"
+
+static struct fb_var_screeninfo v;
+static struct fb_fix_screeninfo f;
+static int dump;
+static const char *dump_path;
+static FILE *out;
+static uint32_t frame;
+
+static void set_field(struct fb_bitfield *b, uint32_t offset, uint32_t length) {
+    b->offset = offset;
+    b->length = length;
+    b->msb_right = 0;
+}
+
+static int headless_open(const fb_options *o, struct fb_var_screeninfo *vinfo,
+        struct fb_fix_screeninfo *finfo, uint8_t **mem) {
+    memset(&v, 0, sizeof(v));
+    memset(&f, 0, sizeof(f));
+    v.xres = v.xres_virtual = o->width;
+    v.yres = v.yres_virtual = o->height;
+    v.bits_per_pixel = o->bpp ? o->bpp : 32;
+    if (v.bits_per_pixel == 16) {
+        // RGB565
+        set_field(&v.red, 11, 5);
+        set_field(&v.green, 5, 6);
+        set_field(&v.blue, 0, 5);
+    } else {
+        // XRGB8888, or its low three bytes
+        set_field(&v.red, 16, 8);
+        set_field(&v.green, 8, 8);
+        set_field(&v.blue, 0, 8);
+    }
+    strncpy(f.id, "headless", sizeof(f.id) - 1);
+    f.visual = FB_VISUAL_TRUECOLOR;
+    f.line_length = v.xres * (v.bits_per_pixel / 8);
+
+    *mem = calloc(v.yres, f.line_length);
+    if (!*mem) {
+        return -1;
+    }
+
+    dump = o->dump;
+    dump_path = o->dump_path;
+    frame = 0;
+    out = NULL;
+    if (dump == FB_DUMP_RAW || dump == FB_DUMP_CHECKSUM) {
+        if (!dump_path || !*dump_path || !strcmp(dump_path, "-")) {
+            out = stdout;
+        } else if (!(out = fopen(dump_path, "wb"))) {
+            perror(dump_path);
+            free(*mem);
+            return -1;
+        }
+    }
+
+    *vinfo = v;
+    *finfo = f;
+    return 0;
+}
+
+static void headless_wait(void) {
+    // nothing to wait for
+}
+
+static uint8_t channel(uint32_t p, const struct fb_bitfield *b) {
+    // widen a channel to 8 bits by repeating its high bits
+    uint32_t c = (p >> b->offset) & ((1u << b->length) - 1);
+    c <<= 8 - b->length;
+    return (uint8_t)(c | (c >> b->length));
+}
+
+static void write_ppm(const uint8_t *mem) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s%06" PRIu32 ".ppm", dump_path ? dump_path : "", frame);
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        perror(path);
+        return;
+    }
+    uint32_t bytes = v.bits_per_pixel / 8;
+    uint8_t *row = malloc(3 * v.xres);
+    fprintf(fp, "P6\n%" PRIu32 " %" PRIu32 "\n255\n", v.xres, v.yres);
+    for (uint32_t y = 0; y < v.yres; y++) {
+        const uint8_t *src = mem + y * f.line_length;
+        for (uint32_t x = 0; x < v.xres; x++, src += bytes) {
+            uint32_t p = src[0] | (src[1] << 8);
+            if (bytes > 2) {
+                p |= src[2] << 16;
+            }
+            row[3 * x] = channel(p, &v.red);
+            row[3 * x + 1] = channel(p, &v.green);
+            row[3 * x + 2] = channel(p, &v.blue);
+        }
+        fwrite(row, 3, v.xres, fp);
+    }
+    free(row);
+    fclose(fp);
+}
+
+static uint64_t checksum(const uint8_t *mem) {
+    // FNV-1a over the visible bytes of each line
+    uint64_t h = 0xcbf29ce484222325ull;
+    uint32_t n = v.xres * (v.bits_per_pixel / 8);
+    for (uint32_t y = 0; y < v.yres; y++) {
+        const uint8_t *src = mem + y * f.line_length;
+        for (uint32_t i = 0; i < n; i++) {
+            h = (h ^ src[i]) * 0x100000001b3ull;
+        }
+    }
+    return h;
+}
+
+static void headless_present(const uint8_t *mem) {
+    switch (dump) {
+    case FB_DUMP_RAW:
+        fwrite(mem, f.line_length, v.yres, out);
+        break;
+    case FB_DUMP_PPM:
+        write_ppm(mem);
+        break;
+    case FB_DUMP_CHECKSUM:
+        fprintf(out, "%06" PRIu32 " %016" PRIx64 "\n", frame, checksum(mem));
+        break;
+    default:
+        break;
+    }
+    frame++;
+}
+
+static void headless_close(uint8_t *mem) {
+    if (out && out != stdout) {
+        fclose(out);
+    } else if (out) {
+        fflush(out);
+    }
+    out = NULL;
+    free(mem);
+}
+
+const fb_backend fb_backend_headless = {
+    "headless", headless_open, headless_wait, headless_present, headless_close, NULL,
+};
@@ -0,0 +1,174 @@
+// Images, part of spectrum.
+//
+// Reads binary netpbm files: PPM (P6), which is opaque, and PAM (P7)
+// with a depth of 1 to 4, which carries alpha when its last channel is
+// one, and PNG when built with libpng. Other formats can be converted
+// with netpbm or ImageMagick.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef HAVE_PNG
+#include <png.h>
+#endif
+
+#include "debug.h"
+#include "image.h"
+
+#define IMG_MAX 8192    // pixels, either way
+
+static int skip_space(FILE *fp) {
+    // skip white space and comments, leaving the next character unread
+    int ch;
+    while ((ch = fgetc(fp)) != EOF) {
+        if (ch == '#') {
+            while ((ch = fgetc(fp)) != EOF && ch != '\n')
+                ;
+        } else if (!isspace(ch)) {
+            ungetc(ch, fp);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int read_ppm_header(FILE *fp, int *w, int *h, int *depth, int *maxval) {
+    *depth = 3;
+    if (skip_space(fp) || fscanf(fp, "%d", w) != 1 ||
+            skip_space(fp) || fscanf(fp, "%d", h) != 1 ||
+            skip_space(fp) || fscanf(fp, "%d", maxval) != 1) {
+        return -1;
+    }
+    // one white space character before the raster
+    fgetc(fp);
+    return 0;
+}
+
+static int read_pam_header(FILE *fp, int *w, int *h, int *depth, int *maxval) {
+    char line[128], key[32];
+    int v;
+    *w = *h = *depth = *maxval = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#') {
+            continue;
+        }
+        if (!strncmp(line, "ENDHDR", 6)) {
+            return 0;
+        }
+        if (sscanf(line, "%31s %d", key, &v) != 2) {
+            continue;   // TUPLTYPE, which depth tells us enough about
+        }
+        if (!strcmp(key, "WIDTH")) {
+            *w = v;
+        } else if (!strcmp(key, "HEIGHT")) {
+            *h = v;
+        } else if (!strcmp(key, "DEPTH")) {
+            *depth = v;
+        } else if (!strcmp(key, "MAXVAL")) {
+            *maxval = v;
+        }
+    }
+    return -1;
+}
+
+#ifdef HAVE_PNG
+static int load_png(image *img, const char *path) {
+    // libpng's simplified API converts any PNG to 8 bit rgba
+    png_image png;
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&png, path)) {
+        return -1;
+    }
+    if (png.width > IMG_MAX || png.height > IMG_MAX) {
+        png_image_free(&png);
+        return -1;
+    }
+    png.format = PNG_FORMAT_RGBA;
+    size_t n = (size_t)png.width * png.height;
+    uint8_t *raw = malloc(PNG_IMAGE_SIZE(png));
+    img->pixels = malloc(n * sizeof(rgba));
+    if (!raw || !img->pixels || !png_image_finish_read(&png, NULL, raw, 0, NULL)) {
+        debug("%s: %s\n", path, png.message);
+        png_image_free(&png);
+        free(raw);
+        free(img->pixels);
+        img->pixels = NULL;
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *s = raw + 4 * i;
+        img->pixels[i] = (rgba){s[0], s[1], s[2], s[3]};
+    }
+    free(raw);
+    img->w = (int)png.width;
+    img->h = (int)png.height;
+    return 0;
+}
+#endif
+
+int img_load(image *img, const char *path) {
+    // Load path into img, returning 0 on success.
+    char magic[3] = {0};
+    int w, h, depth, maxval, err;
+    img->w = img->h = 0;
+    img->pixels = NULL;
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return -1;
+    }
+    if (fread(magic, 1, 2, fp) != 2) {
+        err = -1;
+#ifdef HAVE_PNG
+    } else if (!memcmp(magic, "\x89P", 2)) {
+        fclose(fp);
+        return load_png(img, path);
+#endif
+    } else if (!strcmp(magic, "P6")) {
+        err = read_ppm_header(fp, &w, &h, &depth, &maxval);
+    } else if (!strcmp(magic, "P7")) {
+        err = read_pam_header(fp, &w, &h, &depth, &maxval);
+    } else {
+        err = -1;
+    }
+    if (err || w <= 0 || h <= 0 || w > IMG_MAX || h > IMG_MAX ||
+            depth < 1 || depth > 4 || maxval != 255) {
+        debug("%s: not a PNG or 8 bit PPM or PAM image\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    uint8_t *raw = malloc((size_t)w * h * depth);
+    img->pixels = malloc((size_t)w * h * sizeof(rgba));
+    if (!raw || !img->pixels || fread(raw, (size_t)w * depth, h, fp) != (size_t)h) {
+        free(raw);
+        free(img->pixels);
+        img->pixels = NULL;
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    // gray, gray and alpha, rgb, or rgb and alpha
+    for (size_t i = 0; i < (size_t)w * h; i++) {
+        const uint8_t *s = raw + i * depth;
+        rgba *c = &img->pixels[i];
+        c->r = s[0];
+        c->g = depth >= 3 ? s[1] : s[0];
+        c->b = depth >= 3 ? s[2] : s[0];
+        c->a = depth == 2 ? s[1] : depth == 4 ? s[3] : 0xFF;
+    }
+    free(raw);
+    img->w = w;
+    img->h = h;
+    return 0;
+}
+
+void img_free(image *img) {
+    free(img->pixels);
+    img->pixels = NULL;
+    img->w = img->h = 0;
+}
@@ -0,0 +1,19 @@
+// Images, part of spectrum.
+//
+// Pictures read from files, for skinned needles. Pixels are rgba with
+// rows running down, as in the file; converting them to the buffer
+// format is left to whoever draws them.
+
+#pragma once
+
+#include "framebuffer.h"
+
+typedef struct {
+    int w;
+    int h;
+    rgba *pixels;
+} image;
+
+int img_load(image *img, const char *path);
+
+void img_free(image *img);
@@ -0,0 +1,160 @@
+// Needle sprites, part of spectrum.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "needle.h"
+
+static int init(needle_cache *nc, double step) {
+    memset(nc, 0, sizeof(*nc));
+    nc->n = (int)ceil(360 / step);
+    nc->step = 360.0 / nc->n;
+    nc->sprites = calloc(nc->n, sizeof(sprite));
+    nc->ready = calloc(nc->n, 1);
+    if (!nc->sprites || !nc->ready) {
+        nc_free(nc);
+        return -1;
+    }
+    return 0;
+}
+
+int nc_init_ray(needle_cache *nc, double step, int r0, int r1, int thickness) {
+    if (init(nc, step)) {
+        return -1;
+    }
+    nc->r0 = r0;
+    nc->r1 = r1;
+    nc->thickness = thickness;
+    return 0;
+}
+
+int nc_init_image(needle_cache *nc, double step, image img, double pivot_x, double pivot_y, double scale) {
+    // The cache takes over img. The pivot is in image pixels, from the
+    // top left corner; scale is screen pixels per image pixel.
+    if (init(nc, step)) {
+        img_free(&img);
+        return -1;
+    }
+    nc->img = img;
+    nc->pivot_x = pivot_x;
+    nc->pivot_y = pivot_y;
+    nc->scale = scale;
+    return 0;
+}
+
+static void sample(const image *img, double u, double v, double c[4]) {
+    // bilinear sample at image position u, v, premultiplied by alpha;
+    // outside the image is transparent
+    double fu = floor(u - 0.5), fv = floor(v - 0.5);
+    double du = u - 0.5 - fu, dv = v - 0.5 - fv;
+    int iu = (int)fu, iv = (int)fv;
+    memset(c, 0, 4 * sizeof(double));
+    for (int j = 0; j < 2; j++) {
+        for (int i = 0; i < 2; i++) {
+            int x = iu + i, y = iv + j;
+            if (x < 0 || y < 0 || x >= img->w || y >= img->h) {
+                continue;
+            }
+            const rgba *p = &img->pixels[y * img->w + x];
+            double wt = (i ? du : 1 - du) * (j ? dv : 1 - dv) * p->a / 255;
+            c[0] += wt * p->r;
+            c[1] += wt * p->g;
+            c[2] += wt * p->b;
+            c[3] += wt;
+        }
+    }
+}
+
+static int image_sprite(const needle_cache *nc, double theta, sprite *s) {
+    // turn the picture by theta about its pivot
+    double t = theta * M_PI / 180;
+    double co = cos(t), sn = sin(t), k = nc->scale;
+    const image *img = &nc->img;
+
+    // the corners, relative to the pivot, y up
+    double x0 = INFINITY, x1 = -INFINITY, y0 = INFINITY, y1 = -INFINITY;
+    for (int i = 0; i < 4; i++) {
+        double u = ((i & 1) ? img->w : 0) - nc->pivot_x;
+        double v = nc->pivot_y - ((i & 2) ? img->h : 0);
+        double x = k * (u * co - v * sn), y = k * (u * sn + v * co);
+        x0 = fmin(x0, x);
+        x1 = fmax(x1, x);
+        y0 = fmin(y0, y);
+        y1 = fmax(y1, y);
+    }
+    s->x = (int)floor(x0) - 1;
+    s->y = (int)ceil(y1) + 1;
+    int w = (int)ceil(x1) + 2 - s->x;
+    int h = s->y + 2 - (int)floor(y0);
+    uint8_t *mask = malloc((size_t)w * h);
+    pixel *pixels = malloc((size_t)w * h * sizeof(pixel));
+    if (!mask || !pixels) {
+        free(mask);
+        free(pixels);
+        return -1;
+    }
+
+    // sample at each pixel centre, turned back into the picture
+    for (int r = 0; r < h; r++) {
+        for (int i = 0; i < w; i++) {
+            double x = (s->x + i) / k, y = (s->y - r) / k;
+            double c[4];
+            sample(img, nc->pivot_x + x * co + y * sn, nc->pivot_y - (y * co - x * sn), c);
+            size_t at = (size_t)r * w + i;
+            mask[at] = clamp(255 * c[3] + 0.5);
+            if (c[3] > 0) {
+                rgba q = {clamp(c[0] / c[3]), clamp(c[1] / c[3]), clamp(c[2] / c[3]), 0};
+                pixels[at] = rgba_to_pixel(q);
+            } else {
+                pixels[at] = 0;
+            }
+        }
+    }
+    int err = bf_sprite_pack(s, w, h, mask, pixels);
+    free(mask);
+    free(pixels);
+    return err;
+}
+
+static const sprite *get(needle_cache *nc, int i) {
+    i = ((i % nc->n) + nc->n) % nc->n;
+    if (!nc->ready[i]) {
+        sprite *s = &nc->sprites[i];
+        double theta = i * nc->step;
+        int err = nc->img.pixels ? image_sprite(nc, theta, s)
+            : bf_ray_sprite(nc->r0, nc->r1, theta, nc->thickness, s);
+        if (err) {
+            return NULL;
+        }
+        nc->ready[i] = 1;
+    }
+    return &nc->sprites[i];
+}
+
+void nc_prepare(needle_cache *nc, double theta0, double theta1) {
+    // render the sprites between theta0 and theta1, in degrees
+    int i0 = (int)floor(fmin(theta0, theta1) / nc->step);
+    int i1 = (int)ceil(fmax(theta0, theta1) / nc->step);
+    for (int i = i0; i <= i1 && i < i0 + nc->n; i++) {
+        get(nc, i);
+    }
+}
+
+const sprite *nc_sprite(needle_cache *nc, double theta) {
+    // the sprite nearest theta, or NULL if it could not be made
+    if (!isfinite(theta)) {
+        return NULL;
+    }
+    return get(nc, (int)lround(fmod(theta, 360) / nc->step));
+}
+
+void nc_free(needle_cache *nc) {
+    for (int i = 0; nc->sprites && i < nc->n; i++) {
+        bf_sprite_free(&nc->sprites[i]);
+    }
+    free(nc->sprites);
+    free(nc->ready);
+    img_free(&nc->img);
+    memset(nc, 0, sizeof(*nc));
+}
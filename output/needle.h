@@ -0,0 +1,33 @@
+// Needle sprites, part of spectrum.
+//
+// Meter needles rendered ahead at fine steps of angle, so that drawing
+// one is a blit of the nearest sprite rather than an anti-aliased line.
+// A needle is a ray, as bf_draw_ray draws it, or a picture pointing
+// right from its pivot. Sprites for the angles a meter sweeps are made
+// by nc_prepare; any other angle is rendered the first time it is used.
+
+#pragma once
+
+#include "fbplot.h"
+#include "image.h"
+
+typedef struct {
+    double step;        // degrees between sprites
+    int n;              // sprites around the circle
+    sprite *sprites;    // by angle, from 0
+    uint8_t *ready;
+    // a ray from r0 to r1, or img turned about (pivot_x, pivot_y)
+    int r0, r1, thickness;
+    image img;
+    double pivot_x, pivot_y, scale;
+} needle_cache;
+
+int nc_init_ray(needle_cache *nc, double step, int r0, int r1, int thickness);
+
+int nc_init_image(needle_cache *nc, double step, image img, double pivot_x, double pivot_y, double scale);
+
+void nc_prepare(needle_cache *nc, double theta0, double theta1);
+
+const sprite *nc_sprite(needle_cache *nc, double theta);
+
+void nc_free(needle_cache *nc);
@@ -0,0 +1,331 @@
+// Pixel kernels
+// =============
+//
+// Blend, shade, grayscale and tinge whole rows of pixels.
+//
+// Everything is 8 bit fixed point: factors are scaled to 0..255 (or Q8
+// for shading) and products are divided by 255 with the usual exact
+// rounding trick, so the SIMD and scalar paths agree to the bit.
+// Blending and shading treat the four bytes of a pixel alike and so work
+// for any 32 bit layout. Grayscale and tinge need to know where the
+// colour channels are, which is passed in as a pixel_layout.
+
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PX_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PX_NEON
+#endif
+
+#include "pixops.h"
+
+// relative luminance weights 0.2126, 0.7152, 0.0722 in Q8
+#define Y_R 54
+#define Y_G 183
+#define Y_B 19
+
+
+static inline uint32_t div255(uint32_t x) {
+    // x / 255, rounded, for x <= 255 * 255
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static inline uint32_t div255_lanes(uint32_t x) {
+    // div255 of both 16 bit lanes in x = 0x00XX00YY
+    x += 0x00800080;
+    return ((x + ((x >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+}
+
+static inline uint32_t to_u8(double alpha) {
+    // alpha in [0, 1] to 0..255
+    return (uint32_t)lround(fmin(fmax(alpha, 0.0), 1.0) * 255);
+}
+
+int px_layout(const struct fb_var_screeninfo *vinfo, pixel_layout *l) {
+    // fill in l, returns false if the pixels are not 32 bit with 8 bit channels
+    l->r = vinfo->red.offset;
+    l->g = vinfo->green.offset;
+    l->b = vinfo->blue.offset;
+    return (vinfo->bits_per_pixel == 32) &&
+        (vinfo->red.length == 8) &&
+        (vinfo->green.length == 8) &&
+        (vinfo->blue.length == 8);
+}
+
+void px_blend_row(pixel *d, const pixel *s, size_t n, double alpha) {
+    // d <- alpha * d + (1 - alpha) * s
+    uint32_t a = to_u8(alpha);
+    uint32_t na = 255 - a;
+    size_t i = 0;
+#if defined(PX_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi16(128);
+    const __m128i va = _mm_set1_epi16((short)a);
+    const __m128i vna = _mm_set1_epi16((short)na);
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(d + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i lo = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(x, zero), va),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(y, zero), vna));
+        __m128i hi = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpackhi_epi8(x, zero), va),
+                _mm_mullo_epi16(_mm_unpackhi_epi8(y, zero), vna));
+        lo = _mm_add_epi16(lo, half);
+        hi = _mm_add_epi16(hi, half);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128((__m128i *)(d + i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(PX_NEON)
+    const uint8x8_t va = vdup_n_u8((uint8_t)a);
+    const uint8x8_t vna = vdup_n_u8((uint8_t)na);
+    for (; i + 4 <= n; i += 4) {
+        uint8x16_t x = vld1q_u8((const uint8_t *)(d + i));
+        uint8x16_t y = vld1q_u8((const uint8_t *)(s + i));
+        uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(x), va), vget_low_u8(y), vna);
+        uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(x), va), vget_high_u8(y), vna);
+        uint8x8_t rlo = vrshrn_n_u16(vrsraq_n_u16(lo, lo, 8), 8);
+        uint8x8_t rhi = vrshrn_n_u16(vrsraq_n_u16(hi, hi, 8), 8);
+        vst1q_u8((uint8_t *)(d + i), vcombine_u8(rlo, rhi));
+    }
+#endif
+    for (; i < n; i++) {
+        uint32_t x = d[i];
+        uint32_t y = s[i];
+        uint32_t rb = div255_lanes((x & 0x00FF00FF) * a + (y & 0x00FF00FF) * na);
+        uint32_t ag = div255_lanes(((x >> 8) & 0x00FF00FF) * a + ((y >> 8) & 0x00FF00FF) * na);
+        d[i] = rb | (ag << 8);
+    }
+}
+
+void px_shade_row(pixel *d, size_t n, double alpha) {
+    // d <- alpha * d, saturating, so alpha > 1 brightens
+    uint32_t f = (uint32_t)lround(fmin(fmax(alpha, 0.0), 255.0) * 256);
+    size_t i = 0;
+#if defined(PX_SSE2)
+    // (v << 8) * f >> 16 is v * f >> 8; saturate before the signed pack
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vf = _mm_set1_epi16((short)f);
+    const __m128i sat = _mm_set1_epi16((short)0xFF00);
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(d + i));
+        __m128i lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(zero, x), vf);
+        __m128i hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(zero, x), vf);
+        lo = _mm_sub_epi16(_mm_adds_epu16(lo, sat), sat);
+        hi = _mm_sub_epi16(_mm_adds_epu16(hi, sat), sat);
+        _mm_storeu_si128((__m128i *)(d + i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(PX_NEON)
+    for (; i + 4 <= n; i += 4) {
+        uint8x16_t x = vld1q_u8((const uint8_t *)(d + i));
+        uint16x8_t lo = vmovl_u8(vget_low_u8(x));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(x));
+        uint16x8_t rlo = vcombine_u16(
+                vqshrn_n_u32(vmull_n_u16(vget_low_u16(lo), (uint16_t)f), 8),
+                vqshrn_n_u32(vmull_n_u16(vget_high_u16(lo), (uint16_t)f), 8));
+        uint16x8_t rhi = vcombine_u16(
+                vqshrn_n_u32(vmull_n_u16(vget_low_u16(hi), (uint16_t)f), 8),
+                vqshrn_n_u32(vmull_n_u16(vget_high_u16(hi), (uint16_t)f), 8));
+        vst1q_u8((uint8_t *)(d + i), vcombine_u8(vqmovn_u16(rlo), vqmovn_u16(rhi)));
+    }
+#endif
+    uint8_t *c = (uint8_t *)(d + i);
+    for (size_t j = 0; j < 4 * (n - i); j++) {
+        uint32_t v = (c[j] * f) >> 8;
+        c[j] = (uint8_t)(v > 255 ? 255 : v);
+    }
+}
+
+static inline void grayscale_row(pixel *d, size_t n, pixel_layout l) {
+    // replace the colour channels by the relative luminance
+    uint32_t keep = ~((0xFFu << l.r) | (0xFFu << l.g) | (0xFFu << l.b));
+    size_t i = 0;
+#if defined(PX_SSE2)
+    // one pixel per 32 bit lane; products fit the low 16 bits
+    const __m128i m = _mm_set1_epi32(0xFF);
+    const __m128i vkeep = _mm_set1_epi32((int)keep);
+    const __m128i sr = _mm_cvtsi32_si128((int)l.r);
+    const __m128i sg = _mm_cvtsi32_si128((int)l.g);
+    const __m128i sb = _mm_cvtsi32_si128((int)l.b);
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(d + i));
+        __m128i y = _mm_add_epi32(_mm_add_epi32(
+                _mm_mullo_epi16(_mm_and_si128(_mm_srl_epi32(x, sr), m), _mm_set1_epi32(Y_R)),
+                _mm_mullo_epi16(_mm_and_si128(_mm_srl_epi32(x, sg), m), _mm_set1_epi32(Y_G))),
+                _mm_mullo_epi16(_mm_and_si128(_mm_srl_epi32(x, sb), m), _mm_set1_epi32(Y_B)));
+        y = _mm_srli_epi32(y, 8);
+        x = _mm_or_si128(_mm_and_si128(x, vkeep), _mm_sll_epi32(y, sr));
+        x = _mm_or_si128(_mm_or_si128(x, _mm_sll_epi32(y, sg)), _mm_sll_epi32(y, sb));
+        _mm_storeu_si128((__m128i *)(d + i), x);
+    }
+#elif defined(PX_NEON)
+    const uint32x4_t m = vdupq_n_u32(0xFF);
+    const uint32x4_t vkeep = vdupq_n_u32(keep);
+    const int32x4_t rr = vdupq_n_s32(-(int32_t)l.r), lr = vdupq_n_s32((int32_t)l.r);
+    const int32x4_t rg = vdupq_n_s32(-(int32_t)l.g), lg = vdupq_n_s32((int32_t)l.g);
+    const int32x4_t rb = vdupq_n_s32(-(int32_t)l.b), lb = vdupq_n_s32((int32_t)l.b);
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t x = vld1q_u32(d + i);
+        uint32x4_t y = vmulq_n_u32(vandq_u32(vshlq_u32(x, rr), m), Y_R);
+        y = vmlaq_n_u32(y, vandq_u32(vshlq_u32(x, rg), m), Y_G);
+        y = vmlaq_n_u32(y, vandq_u32(vshlq_u32(x, rb), m), Y_B);
+        y = vshrq_n_u32(y, 8);
+        x = vorrq_u32(vandq_u32(x, vkeep), vshlq_u32(y, lr));
+        x = vorrq_u32(vorrq_u32(x, vshlq_u32(y, lg)), vshlq_u32(y, lb));
+        vst1q_u32(d + i, x);
+    }
+#endif
+    for (; i < n; i++) {
+        uint32_t p = d[i];
+        uint32_t y = (Y_R * ((p >> l.r) & 0xFF) +
+                      Y_G * ((p >> l.g) & 0xFF) +
+                      Y_B * ((p >> l.b) & 0xFF)) >> 8;
+        d[i] = (p & keep) | (y << l.r) | (y << l.g) | (y << l.b);
+    }
+}
+
+static inline void tinge_row(pixel *d, size_t n, pixel_layout l, rgba tc, double alpha) {
+    // d <- (1 - alpha) * d + alpha * y * tc, with y the luminance of d in [0, 1]
+    uint32_t a = to_u8(alpha);
+    uint32_t na = 255 - a;
+    uint32_t tr = tc.r > 255 ? 255 : tc.r;
+    uint32_t tg = tc.g > 255 ? 255 : tc.g;
+    uint32_t tb = tc.b > 255 ? 255 : tc.b;
+    uint32_t keep = ~((0xFFu << l.r) | (0xFFu << l.g) | (0xFFu << l.b));
+    size_t i = 0;
+#if defined(PX_SSE2)
+    const __m128i m = _mm_set1_epi32(0xFF);
+    const __m128i half = _mm_set1_epi32(128);
+    const __m128i vkeep = _mm_set1_epi32((int)keep);
+    const __m128i va = _mm_set1_epi32((int)a);
+    const __m128i vna = _mm_set1_epi32((int)na);
+    const __m128i s[3] = {
+        _mm_cvtsi32_si128((int)l.r), _mm_cvtsi32_si128((int)l.g), _mm_cvtsi32_si128((int)l.b)};
+    const __m128i t[3] = {_mm_set1_epi32((int)tr), _mm_set1_epi32((int)tg), _mm_set1_epi32((int)tb)};
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(d + i));
+        __m128i c[3];
+        for (int k = 0; k < 3; k++) {
+            c[k] = _mm_and_si128(_mm_srl_epi32(x, s[k]), m);
+        }
+        __m128i y = _mm_add_epi32(_mm_add_epi32(
+                _mm_mullo_epi16(c[0], _mm_set1_epi32(Y_R)),
+                _mm_mullo_epi16(c[1], _mm_set1_epi32(Y_G))),
+                _mm_mullo_epi16(c[2], _mm_set1_epi32(Y_B)));
+        y = _mm_srli_epi32(y, 8);
+        __m128i out = _mm_and_si128(x, vkeep);
+        for (int k = 0; k < 3; k++) {
+            // tint = div255(y * tc), then div255(c * (1 - a) + tint * a)
+            __m128i v = _mm_add_epi32(_mm_mullo_epi16(y, t[k]), half);
+            v = _mm_srli_epi32(_mm_add_epi32(v, _mm_srli_epi32(v, 8)), 8);
+            v = _mm_add_epi32(_mm_mullo_epi16(c[k], vna), _mm_mullo_epi16(v, va));
+            v = _mm_add_epi32(v, half);
+            v = _mm_srli_epi32(_mm_add_epi32(v, _mm_srli_epi32(v, 8)), 8);
+            out = _mm_or_si128(out, _mm_sll_epi32(v, s[k]));
+        }
+        _mm_storeu_si128((__m128i *)(d + i), out);
+    }
+#elif defined(PX_NEON)
+    const uint32x4_t m = vdupq_n_u32(0xFF);
+    const uint32x4_t half = vdupq_n_u32(128);
+    const uint32x4_t vkeep = vdupq_n_u32(keep);
+    const int32x4_t rs[3] = {
+        vdupq_n_s32(-(int32_t)l.r), vdupq_n_s32(-(int32_t)l.g), vdupq_n_s32(-(int32_t)l.b)};
+    const int32x4_t ls[3] = {
+        vdupq_n_s32((int32_t)l.r), vdupq_n_s32((int32_t)l.g), vdupq_n_s32((int32_t)l.b)};
+    const uint32_t t[3] = {tr, tg, tb};
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t x = vld1q_u32(d + i);
+        uint32x4_t c[3];
+        for (int k = 0; k < 3; k++) {
+            c[k] = vandq_u32(vshlq_u32(x, rs[k]), m);
+        }
+        uint32x4_t y = vmulq_n_u32(c[0], Y_R);
+        y = vmlaq_n_u32(y, c[1], Y_G);
+        y = vmlaq_n_u32(y, c[2], Y_B);
+        y = vshrq_n_u32(y, 8);
+        uint32x4_t out = vandq_u32(x, vkeep);
+        for (int k = 0; k < 3; k++) {
+            uint32x4_t v = vaddq_u32(vmulq_n_u32(y, t[k]), half);
+            v = vshrq_n_u32(vaddq_u32(v, vshrq_n_u32(v, 8)), 8);
+            v = vmlaq_n_u32(vmulq_n_u32(c[k], na), v, a);
+            v = vaddq_u32(v, half);
+            v = vshrq_n_u32(vaddq_u32(v, vshrq_n_u32(v, 8)), 8);
+            out = vorrq_u32(out, vshlq_u32(v, ls[k]));
+        }
+        vst1q_u32(d + i, out);
+    }
+#endif
+    for (; i < n; i++) {
+        uint32_t p = d[i];
+        uint32_t r = (p >> l.r) & 0xFF;
+        uint32_t g = (p >> l.g) & 0xFF;
+        uint32_t b = (p >> l.b) & 0xFF;
+        uint32_t y = (Y_R * r + Y_G * g + Y_B * b) >> 8;
+        r = div255(r * na + div255(y * tr) * a);
+        g = div255(g * na + div255(y * tg) * a);
+        b = div255(b * na + div255(y * tb) * a);
+        d[i] = (p & keep) | (r << l.r) | (g << l.g) | (b << l.b);
+    }
+}
+
+void px_grayscale_row(pixel *d, size_t n, pixel_layout l) {
+    grayscale_row(d, n, l);
+}
+
+void px_tinge_row(pixel *d, size_t n, pixel_layout l, rgba tc, double alpha) {
+    tinge_row(d, n, l, tc, alpha);
+}
+
+// Variants with the layout fixed at compile time, so that every shift is
+// by a constant, and a generic one that takes it from px_format_for.
+
+#define PX_FORMAT(name, R, G, B)                                                \
+    static void grayscale_##name(pixel *d, size_t n) {                          \
+        grayscale_row(d, n, (pixel_layout){R, G, B});                           \
+    }                                                                           \
+    static void tinge_##name(pixel *d, size_t n, rgba tc, double alpha) {       \
+        tinge_row(d, n, (pixel_layout){R, G, B}, tc, alpha);                    \
+    }                                                                           \
+    static const px_format format_##name = {                                    \
+        #name, {R, G, B}, grayscale_##name, tinge_##name,                       \
+    };
+
+PX_FORMAT(xrgb8888, 16, 8, 0)
+PX_FORMAT(xbgr8888, 0, 8, 16)
+
+static px_format format_generic;
+
+static void grayscale_generic(pixel *d, size_t n) {
+    grayscale_row(d, n, format_generic.l);
+}
+
+static void tinge_generic(pixel *d, size_t n, rgba tc, double alpha) {
+    tinge_row(d, n, format_generic.l, tc, alpha);
+}
+
+const px_format *px_format_for(const struct fb_var_screeninfo *vinfo) {
+    // the kernels for vinfo's layout, or NULL if it is not 32 bit with 8 bit channels
+    pixel_layout l;
+    if (!px_layout(vinfo, &l)) {
+        return NULL;
+    }
+    if (l.r == 16 && l.g == 8 && l.b == 0) {
+        return &format_xrgb8888;
+    }
+    if (l.r == 0 && l.g == 8 && l.b == 16) {
+        return &format_xbgr8888;
+    }
+    format_generic.name = "generic";
+    format_generic.l = l;
+    format_generic.grayscale_row = grayscale_generic;
+    format_generic.tinge_row = tinge_generic;
+    return &format_generic;
+}
@@ -0,0 +1,39 @@
+// Whole-row pixel kernels for buffers of 32 bit pixels
+// with 8 bit channels, in fixed point.
+// SSE2 or NEON is used when the compiler targets it;
+// all paths give identical results.
+
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <linux/fb.h>
+
+#include "framebuffer.h"
+
+// bit offsets of the colour channels within a pixel
+typedef struct {
+    uint32_t r;
+    uint32_t g;
+    uint32_t b;
+} pixel_layout;
+
+int px_layout(const struct fb_var_screeninfo *vinfo, pixel_layout *l);
+
+void px_blend_row(pixel *d, const pixel *s, size_t n, double alpha);
+
+void px_shade_row(pixel *d, size_t n, double alpha);
+
+void px_grayscale_row(pixel *d, size_t n, pixel_layout l);
+
+void px_tinge_row(pixel *d, size_t n, pixel_layout l, rgba tc, double alpha);
+
+// the layout dependent kernels for one pixel format
+struct px_format {
+    const char *name;
+    pixel_layout l;
+    void (*grayscale_row)(pixel *d, size_t n);
+    void (*tinge_row)(pixel *d, size_t n, rgba tc, double alpha);
+};
+
+const px_format *px_format_for(const struct fb_var_screeninfo *vinfo);
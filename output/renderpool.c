@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "renderpool.h"
+#include "debug.h"
+#include "util.h"
+#include "trace.h"
+
+// bands per thread, so that a band that happens to be busy
+// does not leave the other threads waiting
+#define BANDS_PER_THREAD 4
+#define MAX_THREADS 16
+
+static void draw_bands(render_pool *rp) {
+    // Claim and draw bands until none are left. Called with the lock
+    // held; drawing happens without it.
+    while (rp->next_band < rp->bands) {
+        int band = rp->next_band++;
+        pthread_mutex_unlock(&rp->lock);
+
+        // the band, within the caller's clip rectangle
+        buffer b = rp->buff;
+        int y0 = max(band * rp->band_h, (int)b.clip.y);
+        int y1 = min((band + 1) * rp->band_h, (int)(b.clip.y + b.clip.h));
+        if (y1 > y0) {
+            rect r = {b.clip.x, (uint32_t)y0, b.clip.w, (uint32_t)(y1 - y0)};
+            bf_set_clip(&b, r);
+            trace_begin("band");
+            dl_render(rp->dl, b);
+            trace_end("band");
+        }
+
+        pthread_mutex_lock(&rp->lock);
+        if (++rp->bands_done == rp->bands) {
+            pthread_cond_signal(&rp->done);
+        }
+    }
+}
+
+static void *worker(void *data) {
+    render_pool *rp = (render_pool *)data;
+    unsigned long seen = 0;
+    trace_thread("render");
+    pthread_mutex_lock(&rp->lock);
+    while (!rp->quit) {
+        if (rp->frame == seen) {
+            pthread_cond_wait(&rp->start, &rp->lock);
+            continue;
+        }
+        seen = rp->frame;
+        draw_bands(rp);
+    }
+    pthread_mutex_unlock(&rp->lock);
+    return NULL;
+}
+
+int rp_init(render_pool *rp, int threads) {
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    rp->threads = min(max(threads, 1), MAX_THREADS);
+    rp->frame = 0;
+    rp->quit = 0;
+    rp->next_band = rp->bands = rp->bands_done = 0;
+    pthread_mutex_init(&rp->lock, NULL);
+    pthread_cond_init(&rp->start, NULL);
+    pthread_cond_init(&rp->done, NULL);
+
+    // the caller draws too, so one thread fewer
+    rp->workers = calloc(rp->threads, sizeof(pthread_t));
+    for (int i = 0; i < rp->threads - 1; i++) {
+        if (pthread_create(&rp->workers[i], NULL, worker, rp)) {
+            rp->threads = i + 1;
+            break;
+        }
+    }
+    debug("render pool: %d threads\n", rp->threads);
+    return rp->threads;
+}
+
+void rp_free(render_pool *rp) {
+    pthread_mutex_lock(&rp->lock);
+    rp->quit = 1;
+    pthread_cond_broadcast(&rp->start);
+    pthread_mutex_unlock(&rp->lock);
+    for (int i = 0; i < rp->threads - 1; i++) {
+        pthread_join(rp->workers[i], NULL);
+    }
+    free(rp->workers);
+    pthread_cond_destroy(&rp->done);
+    pthread_cond_destroy(&rp->start);
+    pthread_mutex_destroy(&rp->lock);
+}
+
+void rp_render(render_pool *rp, const display_list *dl, const buffer buff) {
+    if (rp->threads == 1) {
+        dl_render(dl, buff);
+        return;
+    }
+
+    pthread_mutex_lock(&rp->lock);
+    rp->dl = dl;
+    rp->buff = buff;
+    rp->bands = rp->threads * BANDS_PER_THREAD;
+    rp->band_h = ((int)buff.h + rp->bands - 1) / rp->bands;
+    rp->next_band = 0;
+    rp->bands_done = 0;
+    rp->frame++;
+    pthread_cond_broadcast(&rp->start);
+
+    draw_bands(rp);
+    while (rp->bands_done < rp->bands) {
+        pthread_cond_wait(&rp->done, &rp->lock);
+    }
+    pthread_mutex_unlock(&rp->lock);
+}
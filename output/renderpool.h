@@ -0,0 +1,34 @@
+// A pool of render threads, part of spectrum.
+//
+// rp_render replays a display list into a buffer split into horizontal
+// bands. The bands are shared out between the pool's threads and the
+// caller, and rp_render returns once every band is drawn, so the
+// buffer is complete for bf_blit.
+
+#pragma once
+
+#include <pthread.h>
+
+#include "fbplot.h"
+#include "displaylist.h"
+
+typedef struct {
+    int threads;            // including the caller
+    pthread_t *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t start;   // a new frame is ready
+    pthread_cond_t done;    // the last band of a frame is finished
+    // the frame being drawn
+    const display_list *dl;
+    buffer buff;
+    int bands, band_h;
+    int next_band, bands_done;
+    unsigned long frame;
+    int quit;
+} render_pool;
+
+// threads is the number of threads to draw with, 0 for one per CPU
+int rp_init(render_pool *rp, int threads);
+void rp_free(render_pool *rp);
+
+void rp_render(render_pool *rp, const display_list *dl, const buffer buff);
@@ -0,0 +1,475 @@
+// Signed distance field fonts, part of spectrum.
+//
+// Distances come from exact Euclidean distance transforms of the glyph
+// bitmap, inside and out (Felzenszwalb and Huttenlocher, "Distance
+// Transforms of Sampled Functions"). Drawing samples them bilinearly and
+// turns distance into coverage over one output pixel, which gives the
+// anti-aliasing.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "debug.h"
+#include "sdffont.h"
+#include "util.h"
+
+#define SDF_SIZE 48         // pixels per em of the atlas
+#define SDF_SPREAD 6
+#define SDF_OVERSAMPLE 4    // the glyphs are rendered this much larger
+#define SDF_ATLAS_W 512
+#define EDT_INF 1e20f
+
+static const char magic[8] = "SPSDF1";
+
+/* distance transforms */
+
+static void edt_1d(const float *f, int n, float *d, int *v, float *z) {
+    // squared distance to the nearest sample, weighted by f, along a line
+    int k = 0;
+    v[0] = 0;
+    z[0] = -EDT_INF;
+    z[1] = EDT_INF;
+    for (int q = 1; q < n; q++) {
+        // z[0] is -EDT_INF, so k stays at 0 or above
+        float s;
+        for (;;) {
+            int p = v[k];
+            s = ((f[q] + (float)q * q) - (f[p] + (float)p * p)) / (2.0f * (q - p));
+            if (s > z[k]) {
+                break;
+            }
+            k--;
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = EDT_INF;
+    }
+    k = 0;
+    for (int q = 0; q < n; q++) {
+        while (z[k + 1] < q) {
+            k++;
+        }
+        d[q] = (float)(q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+}
+
+static int edt(float *g, int w, int h) {
+    // in place: 0 where the set is, EDT_INF elsewhere, becomes the
+    // squared distance to the set
+    int n = max(w, h);
+    float *f = malloc(n * sizeof(float));
+    float *d = malloc(n * sizeof(float));
+    float *z = malloc((n + 1) * sizeof(float));
+    int *v = malloc(n * sizeof(int));
+    if (!f || !d || !z || !v) {
+        free(f);
+        free(d);
+        free(z);
+        free(v);
+        return -1;
+    }
+    for (int x = 0; x < w; x++) {
+        for (int y = 0; y < h; y++) {
+            f[y] = g[y * w + x];
+        }
+        edt_1d(f, h, d, v, z);
+        for (int y = 0; y < h; y++) {
+            g[y * w + x] = d[y];
+        }
+    }
+    for (int y = 0; y < h; y++) {
+        memcpy(f, g + y * w, w * sizeof(float));
+        edt_1d(f, w, g + y * w, v, z);
+    }
+    free(f);
+    free(d);
+    free(z);
+    free(v);
+    return 0;
+}
+
+/* making the atlas */
+
+static uint8_t *glyph_field(FT_GlyphSlot slot, int spread, int *w, int *h, int *left, int *top) {
+    // The distance field of the glyph in slot, rendered SDF_OVERSAMPLE
+    // times larger than the atlas so that its outline is placed to a
+    // fraction of an atlas pixel. The box is padded by spread and is
+    // left, top from the pen.
+    const int os = SDF_OVERSAMPLE, pad = spread * os;
+    int bw = (int)slot->bitmap.width, bh = (int)slot->bitmap.rows;
+    int bl = slot->bitmap_left, bt = slot->bitmap_top;
+    int hw = bw + 2 * pad, hh = bh + 2 * pad;
+    size_t n = (size_t)hw * hh;
+    float *out = malloc(n * sizeof(float));
+    float *in = malloc(n * sizeof(float));
+    if (!out || !in) {
+        free(out);
+        free(in);
+        return NULL;
+    }
+    for (int y = 0; y < hh; y++) {
+        for (int x = 0; x < hw; x++) {
+            int bx = x - pad, by = y - pad;
+            int inside = bx >= 0 && by >= 0 && bx < bw && by < bh &&
+                slot->bitmap.buffer[by * slot->bitmap.pitch + bx] >= 128;
+            out[y * hw + x] = inside ? 0 : EDT_INF;
+            in[y * hw + x] = inside ? EDT_INF : 0;
+        }
+    }
+    if (edt(out, hw, hh) || edt(in, hw, hh)) {
+        free(out);
+        free(in);
+        return NULL;
+    }
+    for (size_t i = 0; i < n; i++) {
+        // signed, from pixel centres, so the outline is half a pixel away
+        out[i] = in[i] > 0 ? sqrtf(in[i]) - 0.5f : 0.5f - sqrtf(out[i]);
+    }
+    free(in);
+
+    // the atlas box, in atlas pixels
+    *left = (int)floor((double)bl / os) - spread;
+    *top = (int)ceil((double)bt / os) + spread;
+    *w = (int)ceil((double)(bl + bw) / os) + spread - *left;
+    *h = *top - ((int)floor((double)(bt - bh) / os) - spread);
+    uint8_t *field = malloc((size_t)*w * *h);
+    if (!field) {
+        free(out);
+        return NULL;
+    }
+    for (int cy = 0; cy < *h; cy++) {
+        for (int cx = 0; cx < *w; cx++) {
+            // the atlas pixel centre in the large render, bilinearly
+            double hx = (*left + cx + 0.5) * os - bl - 0.5 + pad;
+            double hy = bt - (*top - cy - 0.5) * os - 0.5 + pad;
+            int ix = (int)floor(hx), iy = (int)floor(hy);
+            double fx = hx - ix, fy = hy - iy, d = 0;
+            for (int j = 0; j < 2; j++) {
+                for (int i = 0; i < 2; i++) {
+                    int x = ix + i, y = iy + j;
+                    double v = (x < 0 || y < 0 || x >= hw || y >= hh) ? -pad : out[y * hw + x];
+                    d += v * (i ? fx : 1 - fx) * (j ? fy : 1 - fy);
+                }
+            }
+            field[cy * *w + cx] = clamp(128 + d / os * 127 / spread + 0.5);
+        }
+    }
+    free(out);
+    return field;
+}
+
+static int make_atlas(sdf_font *f, FT_Face face) {
+    uint8_t *fields[SDF_GLYPHS] = {0};
+    int fw[SDF_GLYPHS] = {0}, fh[SDF_GLYPHS] = {0};
+    int x = 0, y = 0, row_h = 0, err = 0;
+
+    f->size = SDF_SIZE;
+    f->spread = SDF_SPREAD;
+    f->w = SDF_ATLAS_W;
+    FT_Set_Pixel_Sizes(face, 0, SDF_SIZE * SDF_OVERSAMPLE);
+
+    // render and place each glyph, in shelves
+    for (int i = 0; i < SDF_GLYPHS; i++) {
+        sdf_glyph *g = &f->glyphs[i];
+        memset(g, 0, sizeof(*g));
+        if (FT_Load_Char(face, SDF_FIRST + i, FT_LOAD_RENDER)) {
+            continue;
+        }
+        g->advance = face->glyph->advance.x / (64.0f * SDF_OVERSAMPLE);
+        if (!face->glyph->bitmap.width || !face->glyph->bitmap.rows) {
+            continue;
+        }
+        int left, top;
+        fields[i] = glyph_field(face->glyph, SDF_SPREAD, &fw[i], &fh[i], &left, &top);
+        if (!fields[i] || fw[i] > SDF_ATLAS_W) {
+            err = -1;
+            break;
+        }
+        if (x + fw[i] > SDF_ATLAS_W) {
+            x = 0;
+            y += row_h;
+            row_h = 0;
+        }
+        g->x = x;
+        g->y = y;
+        g->w = fw[i];
+        g->h = fh[i];
+        g->left = left;
+        g->top = top;
+        x += fw[i];
+        row_h = max(row_h, fh[i]);
+    }
+    f->h = y + row_h;
+    f->atlas = err ? NULL : calloc((size_t)f->w * max(f->h, 1), 1);
+    if (!f->atlas) {
+        err = -1;
+    }
+    for (int i = 0; i < SDF_GLYPHS; i++) {
+        const sdf_glyph *g = &f->glyphs[i];
+        for (int r = 0; !err && fields[i] && r < g->h; r++) {
+            memcpy(f->atlas + (size_t)(g->y + r) * f->w + g->x, fields[i] + r * g->w, g->w);
+        }
+        free(fields[i]);
+    }
+    return err;
+}
+
+/* the cache file */
+
+typedef struct {
+    char magic[8];
+    int64_t font_bytes, font_mtime;
+    int32_t size, spread, oversample, w, h;
+} cache_header;
+
+static void cache_path(char *path, size_t n, const char *font_path, const char *cache_dir) {
+    // one file per font, named by a hash of its path
+    char dir[PATH_MAX];
+    uint32_t hash = 2166136261u;
+    for (const char *c = font_path; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    if (cache_dir && cache_dir[0]) {
+        snprintf(dir, sizeof(dir), "%s", cache_dir);
+    } else if (getenv("XDG_CACHE_HOME")) {
+        snprintf(dir, sizeof(dir), "%s/%s", getenv("XDG_CACHE_HOME"), PACKAGE);
+    } else if (getenv("HOME")) {
+        snprintf(dir, sizeof(dir), "%s/.cache", getenv("HOME"));
+        mkdir(dir, 0777);
+        snprintf(dir, sizeof(dir), "%s/.cache/%s", getenv("HOME"), PACKAGE);
+    } else {
+        path[0] = '\0';
+        return;
+    }
+    mkdir(dir, 0777);
+    snprintf(path, n, "%s/%08x.sdf", dir, hash);
+}
+
+static int read_cache(sdf_font *f, const char *path, const cache_header *want) {
+    cache_header h;
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return -1;
+    }
+    int err = fread(&h, sizeof(h), 1, fp) != 1 || memcmp(&h, want, offsetof(cache_header, w)) ||
+        h.w <= 0 || h.h <= 0 || h.w > 4096 || h.h > 4096 ||
+        fread(f->glyphs, sizeof(f->glyphs), 1, fp) != 1;
+    if (!err) {
+        f->size = h.size;
+        f->spread = h.spread;
+        f->w = h.w;
+        f->h = h.h;
+        f->atlas = malloc((size_t)f->w * f->h);
+        err = !f->atlas || fread(f->atlas, (size_t)f->w * f->h, 1, fp) != 1;
+    }
+    fclose(fp);
+    if (err) {
+        free(f->atlas);
+        f->atlas = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void write_cache(const sdf_font *f, const char *path, const cache_header *head) {
+    // written aside and renamed, so a reader never sees half a file
+    char tmp[PATH_MAX + 8];
+    cache_header h = *head;
+    h.w = f->w;
+    h.h = f->h;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        return;
+    }
+    int err = fwrite(&h, sizeof(h), 1, fp) != 1 ||
+        fwrite(f->glyphs, sizeof(f->glyphs), 1, fp) != 1 ||
+        fwrite(f->atlas, (size_t)f->w * f->h, 1, fp) != 1;
+    err |= fclose(fp) != 0;
+    if (err || rename(tmp, path)) {
+        remove(tmp);
+    }
+}
+
+int sdf_load(sdf_font *f, FT_Face face, const char *font_path, const char *cache_dir) {
+    // The atlas for face, from the cache if it is there and was made from
+    // the same font file, else made now and cached. Returns 0 on success.
+    char path[PATH_MAX + 16];
+    struct stat st;
+    cache_header h;
+    memset(f, 0, sizeof(*f));
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, magic, sizeof(magic));
+    if (!stat(font_path, &st)) {
+        h.font_bytes = st.st_size;
+        h.font_mtime = st.st_mtime;
+    }
+    h.size = SDF_SIZE;
+    h.spread = SDF_SPREAD;
+    h.oversample = SDF_OVERSAMPLE;
+
+    cache_path(path, sizeof(path), font_path, cache_dir);
+    if (path[0] && !read_cache(f, path, &h)) {
+        debug("sdf: %s from %s\n", font_path, path);
+        return 0;
+    }
+    if (make_atlas(f, face)) {
+        sdf_free(f);
+        return -1;
+    }
+    debug("sdf: made %dx%d atlas for %s\n", f->w, f->h, font_path);
+    if (path[0]) {
+        write_cache(f, path, &h);
+    }
+    return 0;
+}
+
+void sdf_free(sdf_font *f) {
+    free(f->atlas);
+    memset(f, 0, sizeof(*f));
+}
+
+/* drawing */
+
+static const sdf_glyph *glyph(const sdf_font *f, char c) {
+    int i = (uint8_t)c - SDF_FIRST;
+    return (i >= 0 && i < SDF_GLYPHS) ? &f->glyphs[i] : NULL;
+}
+
+double sdf_width(const sdf_font *f, const char *text, int num_chars, double px) {
+    // advance of the text at px pixels per em
+    double k = px / f->size, width = 0;
+    for (int n = 0; n < num_chars; n++) {
+        const sdf_glyph *g = glyph(f, text[n]);
+        if (g) {
+            width += g->advance * k;
+        }
+    }
+    return width;
+}
+
+static inline int texel(const uint8_t *row, int x, int w) {
+    // the atlas byte at x of a glyph row; outside the box, or with no
+    // row, is far outside the glyph
+    return (row && x >= 0 && x < w) ? row[x] : 0;
+}
+
+int sdf_text_mask(const sdf_font *f, const char *text, int num_chars, double px, double x, int y, text_mask *tm) {
+    // Text at px pixels per em with its pen starting at x on baseline y,
+    // as a coverage mask like bf_text_mask's.
+    double k = px / f->size;
+    double pen = 0, x0 = INFINITY, x1 = -INFINITY, top = -INFINITY, bottom = INFINITY;
+
+    tm->mask = NULL;
+    tm->w = tm->h = 0;
+    for (int n = 0; n < num_chars; n++) {
+        const sdf_glyph *g = glyph(f, text[n]);
+        if (!g) {
+            continue;
+        }
+        if (g->w) {
+            x0 = fmin(x0, x + pen + g->left * k);
+            x1 = fmax(x1, x + pen + (g->left + g->w) * k);
+            top = fmax(top, g->top * k);
+            bottom = fmin(bottom, (g->top - g->h) * k);
+        }
+        pen += g->advance * k;
+    }
+    if (x0 >= x1) {
+        return 0;
+    }
+    tm->x = (int)floor(x0);
+    tm->y = y + (int)ceil(top);
+    tm->w = (int)ceil(x1) - tm->x;
+    tm->h = tm->y - (y + (int)floor(bottom));
+    tm->mask = calloc((size_t)tm->w * tm->h, 1);
+    if (!tm->mask) {
+        return -1;
+    }
+
+    // Coverage is the distance in output pixels plus a half, so it is
+    // d * scale + offset for an atlas byte d. Texels at or below clear
+    // cover nothing and those at or above solid cover the pixel, so
+    // squares wholly on one side of that band need no interpolation.
+    float scale = (float)(f->spread * k / 127);
+    float offset = 0.5f - 128 * scale;
+    int clear = (int)floor(-offset / scale);
+    int solid = (int)ceil((1 - offset) / scale);
+
+    int columns[SDF_ATLAS_W + 2], *first = columns + 1;
+    pen = x;
+    for (int n = 0; n < num_chars; n++) {
+        const sdf_glyph *g = glyph(f, text[n]);
+        if (!g) {
+            continue;
+        }
+        if (g->w && g->w <= SDF_ATLAS_W) {
+            // the mask pixels the glyph's box reaches
+            double gx = pen + g->left * k;
+            int c0 = max(0, (int)floor(gx) - tm->x);
+            int c1 = min(tm->w, (int)ceil(gx + g->w * k) - tm->x);
+            int r0 = max(0, tm->y - y - (int)ceil(g->top * k));
+            int r1 = min(tm->h, tm->y - y - (int)floor((g->top - g->h) * k) + 1);
+            const uint8_t *atlas = f->atlas + (size_t)g->y * f->w + g->x;
+            // u and v are texel coordinates less half a texel, so that
+            // their floors are the top left texel of the bilinear square
+            float inv = (float)(1 / k);
+            float u0 = (float)((tm->x + 0.5 - pen) / k - g->left - 0.5);
+            // first[iu] is the first pixel whose centre is over texel
+            // column iu, from -1 to g->w, the same on every row
+            for (int iu = -1, i = c0; iu <= g->w; iu++) {
+                while (i < c1 && u0 + i * inv < iu) {
+                    i++;
+                }
+                first[iu] = i;
+            }
+            for (int r = r0; r < r1; r++) {
+                // pixel centres, y up from the baseline
+                float v = (float)(g->top - (tm->y - r - y - 0.5) / k - 0.5);
+                if (v < -1 || v >= g->h) {
+                    continue;
+                }
+                int iv = (int)(v + 1) - 1;
+                float dv = v - iv;
+                const uint8_t *row0 = iv >= 0 ? atlas + (size_t)iv * f->w : NULL;
+                const uint8_t *row1 = iv + 1 < g->h ? atlas + (size_t)(iv + 1) * f->w : NULL;
+                uint8_t *m = tm->mask + (size_t)r * tm->w;
+                // The row a texel square at a time; only squares that
+                // straddle the edge are interpolated.
+                for (int iu = -1; iu < g->w; iu++) {
+                    int i = first[iu], end = first[iu + 1];
+                    if (i == end) {
+                        continue;
+                    }
+                    int t00 = texel(row0, iu, g->w), t10 = texel(row0, iu + 1, g->w);
+                    int t01 = texel(row1, iu, g->w), t11 = texel(row1, iu + 1, g->w);
+                    if (max(max(t00, t10), max(t01, t11)) <= clear) {
+                        continue;
+                    }
+                    if (min(min(t00, t10), min(t01, t11)) >= solid) {
+                        memset(m + i, 0xFF, end - i);
+                        continue;
+                    }
+                    for (; i < end; i++) {
+                        float du = u0 + i * inv - iu;
+                        float top0 = t00 + (t10 - t00) * du;
+                        float top1 = t01 + (t11 - t01) * du;
+                        float c = (top0 + (top1 - top0) * dv) * scale + offset;
+                        if (c > 0) {
+                            uint32_t a = c >= 1 ? 255 : (uint32_t)(c * 255 + 0.5f);
+                            m[i] = (uint8_t)(m[i] + a - (m[i] * a + 127) / 255);
+                        }
+                    }
+                }
+            }
+        }
+        pen += g->advance * k;
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+// Signed distance field fonts, part of spectrum.
+//
+// Each printable ASCII glyph of a face is rendered once, at a fixed
+// size, as the distance to its outline. Text of any size is then drawn
+// by sampling those distances, so the sizes in use cost no rasterising
+// or memory of their own. Atlases are written to a cache file and read
+// back while the font file is unchanged.
+
+#pragma once
+
+#include <inttypes.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "fbplot.h"
+
+#define SDF_FIRST 32    // glyphs ' ' to '~'
+#define SDF_GLYPHS 95
+
+typedef struct {
+    uint16_t x, y, w, h;    // box in the atlas
+    int16_t left, top;      // box from the pen, y up
+    float advance;
+} sdf_glyph;
+
+typedef struct {
+    int size;           // pixels per em the atlas was made at
+    int spread;         // pixels of distance either side of an edge
+    int w, h;
+    uint8_t *atlas;     // 128 on the outline, larger inside
+    sdf_glyph glyphs[SDF_GLYPHS];
+} sdf_font;
+
+int sdf_load(sdf_font *f, FT_Face face, const char *font_path, const char *cache_dir);
+
+void sdf_free(sdf_font *f);
+
+double sdf_width(const sdf_font *f, const char *text, int num_chars, double px);
+
+int sdf_text_mask(const sdf_font *f, const char *text, int num_chars, double px, double x, int y, text_mask *tm);
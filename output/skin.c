@@ -0,0 +1,219 @@
+// Skins, part of spectrum.
+//
+// The cache file holds the face in the buffer format and the needle as
+// 8 bit rgba, after a header recording what they were made from: the
+// files' names, sizes and times, the screen buffer's layout and how a
+// colour packs into the buffer format. If any of it differs the images
+// are decoded again and the cache rewritten.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "debug.h"
+#include "skin.h"
+
+static const char magic[8] = "SPSKIN1";
+
+typedef struct {
+    char magic[8];
+    int64_t face_bytes, face_mtime;
+    int64_t needle_bytes, needle_mtime;
+    uint32_t paths;             // hash of both file names
+    uint32_t w, h, stride;      // of the screen buffer
+    pixel probe;                // a colour, packed
+    int32_t has_face;
+    // the rest is what was cached, not what it must match
+    int32_t needle_w, needle_h;
+} cache_header;
+
+static void file_stamp(const char *path, int64_t *bytes, int64_t *mtime) {
+    struct stat st;
+    *bytes = *mtime = -1;
+    if (path[0] && !stat(path, &st)) {
+        *bytes = st.st_size;
+        *mtime = st.st_mtime;
+    }
+}
+
+static uint32_t hash(uint32_t h, const char *s) {
+    // FNV-1a, including the terminator so that "ab", "" and "a", "b" differ
+    do {
+        h = (h ^ (uint8_t)*s) * 16777619u;
+    } while (*s++);
+    return h;
+}
+
+/* decoding */
+
+static void scale_face(const image *img, const buffer *face) {
+    // Stretch img over the face, bilinearly, onto black where it is
+    // transparent. Both have their top row first.
+    double kx = (double)img->w / face->w, ky = (double)img->h / face->h;
+    for (uint32_t y = 0; y < face->h; y++) {
+        double v = (y + 0.5) * ky - 0.5;
+        int v0 = (int)floor(v);
+        double dv = v - v0;
+        int v1 = v0 + 1 < img->h ? v0 + 1 : img->h - 1;
+        v0 = v0 < 0 ? 0 : v0;
+        pixel *row = face->pixels + (size_t)y * face->stride;
+        for (uint32_t x = 0; x < face->w; x++) {
+            double u = (x + 0.5) * kx - 0.5;
+            int u0 = (int)floor(u);
+            double du = u - u0;
+            int u1 = u0 + 1 < img->w ? u0 + 1 : img->w - 1;
+            u0 = u0 < 0 ? 0 : u0;
+            const rgba *q[4] = {
+                &img->pixels[v0 * img->w + u0], &img->pixels[v0 * img->w + u1],
+                &img->pixels[v1 * img->w + u0], &img->pixels[v1 * img->w + u1],
+            };
+            double wt[4] = {(1 - du) * (1 - dv), du * (1 - dv), (1 - du) * dv, du * dv};
+            double c[3] = {0, 0, 0};
+            for (int i = 0; i < 4; i++) {
+                double a = wt[i] * q[i]->a / 255;
+                c[0] += a * q[i]->r;
+                c[1] += a * q[i]->g;
+                c[2] += a * q[i]->b;
+            }
+            row[x] = rgba_to_pixel((rgba){clamp(c[0]), clamp(c[1]), clamp(c[2]), 0});
+        }
+    }
+}
+
+static int decode(skin *s, const char *face_path, const char *needle_path) {
+    // Returns 0 if every named file was read.
+    int err = 0;
+    image img;
+    if (face_path[0]) {
+        if (!img_load(&img, face_path)) {
+            bf_init(&s->face);
+            if (s->face.pixels) {
+                scale_face(&img, &s->face);
+            } else {
+                err = -1;
+            }
+            img_free(&img);
+        } else {
+            err = -1;
+        }
+    }
+    if (needle_path[0] && img_load(&s->needle, needle_path)) {
+        err = -1;
+    }
+    return err;
+}
+
+/* the cache */
+
+static int read_cache(skin *s, const char *path, const cache_header *want) {
+    cache_header h;
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return -1;
+    }
+    int err = fread(&h, sizeof(h), 1, fp) != 1 || memcmp(&h, want, offsetof(cache_header, needle_w)) ||
+        h.needle_w < 0 || h.needle_h < 0 || h.needle_w > 8192 || h.needle_h > 8192;
+    if (!err && h.has_face) {
+        bf_init(&s->face);
+        err = !s->face.pixels ||
+            fread(s->face.pixels, sizeof(pixel), s->face.size, fp) != s->face.size;
+    }
+    if (!err && h.needle_w && h.needle_h) {
+        size_t n = (size_t)h.needle_w * h.needle_h;
+        uint8_t *raw = malloc(4 * n);
+        s->needle.pixels = malloc(n * sizeof(rgba));
+        err = !raw || !s->needle.pixels || fread(raw, 4, n, fp) != n;
+        for (size_t i = 0; !err && i < n; i++) {
+            const uint8_t *q = raw + 4 * i;
+            s->needle.pixels[i] = (rgba){q[0], q[1], q[2], q[3]};
+        }
+        s->needle.w = h.needle_w;
+        s->needle.h = h.needle_h;
+        free(raw);
+    }
+    fclose(fp);
+    if (err) {
+        skin_free(s);
+        return -1;
+    }
+    return 0;
+}
+
+static void write_cache(const skin *s, const char *path, const cache_header *head) {
+    // written aside and renamed, so a reader never sees half a file
+    char tmp[PATH_MAX + 8];
+    cache_header h = *head;
+    size_t n = (size_t)s->needle.w * s->needle.h;
+    uint8_t *raw = malloc(4 * n + 1);
+    if (!raw) {
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const rgba *c = &s->needle.pixels[i];
+        uint8_t *q = raw + 4 * i;
+        q[0] = c->r;
+        q[1] = c->g;
+        q[2] = c->b;
+        q[3] = c->a;
+    }
+    h.needle_w = s->needle.w;
+    h.needle_h = s->needle.h;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        free(raw);
+        return;
+    }
+    int err = fwrite(&h, sizeof(h), 1, fp) != 1 ||
+        (s->face.pixels && fwrite(s->face.pixels, sizeof(pixel), s->face.size, fp) != s->face.size) ||
+        fwrite(raw, 4, n, fp) != n;
+    err |= fclose(fp) != 0;
+    if (err || rename(tmp, path)) {
+        remove(tmp);
+    }
+    free(raw);
+}
+
+int skin_load(skin *s, const char *face_path, const char *needle_path, const char *cache_path) {
+    // The face and needle, from the cache if it was made from the same
+    // files for the same screen, else decoded now and cached. Either
+    // path may be empty. Returns 0 if everything named was loaded; what
+    // could be is kept anyway. The screen must be set up.
+    cache_header h;
+    memset(s, 0, sizeof(*s));
+    if (!face_path[0] && !needle_path[0]) {
+        return 0;
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, magic, sizeof(magic));
+    file_stamp(face_path, &h.face_bytes, &h.face_mtime);
+    file_stamp(needle_path, &h.needle_bytes, &h.needle_mtime);
+    h.paths = hash(hash(2166136261u, face_path), needle_path);
+    fb_buffer_size(&h.w, &h.h, &h.stride);
+    h.probe = rgba_to_pixel((rgba){0x12, 0x34, 0x56, 0});
+    h.has_face = face_path[0] != '\0';
+
+    if (cache_path[0] && !read_cache(s, cache_path, &h)) {
+        debug("skin: from %s\n", cache_path);
+        return 0;
+    }
+    if (decode(s, face_path, needle_path)) {
+        return -1;
+    }
+    debug("skin: decoded %s %s\n", face_path, needle_path);
+    if (cache_path[0]) {
+        write_cache(s, cache_path, &h);
+    }
+    return 0;
+}
+
+void skin_free(skin *s) {
+    bf_free_pixels(&s->face);
+    img_free(&s->needle);
+    memset(s, 0, sizeof(*s));
+}
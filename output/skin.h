@@ -0,0 +1,22 @@
+// Skins, part of spectrum.
+//
+// Artwork for the meters: a face drawn behind every frame in place of
+// the cleared screen, and a needle picture for the needle cache. The
+// files are decoded, the face scaled to the screen and packed into the
+// buffer format once, when the skin is loaded; the result is kept in a
+// cache file, so that the next start only reads it back. Drawing the
+// face is a copy of its rows.
+
+#pragma once
+
+#include "fbplot.h"
+#include "image.h"
+
+typedef struct {
+    buffer face;        // laid out as bf_init lays out the screen; no pixels without a face
+    image needle;       // rgba, rows down; no pixels without a needle
+} skin;
+
+int skin_load(skin *s, const char *face_path, const char *needle_path, const char *cache_path);
+
+void skin_free(skin *s);
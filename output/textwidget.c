@@ -0,0 +1,85 @@
+// Text widgets, part of spectrum.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "textwidget.h"
+
+void tw_init(text_widgets *tw) {
+    memset(tw, 0, sizeof(*tw));
+}
+
+void tw_free(text_widgets *tw) {
+    // drop every widget, as when the fonts change
+    for (int i = 0; i < tw->n; i++) {
+        bf_sprite_free(&tw->w[i].s);
+    }
+    tw_init(tw);
+}
+
+static text_widget *find(text_widgets *tw, const display_list *dl, int size, int center,
+        uint32_t x, uint32_t y, int style) {
+    // the widget at this place, else a free slot or the one unused the
+    // longest, but never one the list being recorded still refers to
+    text_widget *spare = NULL;
+    for (int i = 0; i < tw->n; i++) {
+        text_widget *w = &tw->w[i];
+        if (w->x == x && w->y == y && w->size == size && w->center == center && w->style == style) {
+            return w;
+        }
+        if (w->frame != dl->frame && (!spare || w->used < spare->used)) {
+            spare = w;
+        }
+    }
+    if (tw->n < TW_MAX) {
+        tw->w[tw->n].len = -1;
+        return &tw->w[tw->n++];
+    }
+    if (spare) {
+        bf_sprite_free(&spare->s);
+        spare->len = -1;
+    }
+    return spare;
+}
+
+void tw_text(text_widgets *tw, display_list *dl, char *text, int num_chars, int size, int center,
+        uint32_t x, uint32_t y, int style, rgba c) {
+    // dl_text, drawn from the widget for this place
+    if (num_chars < 0 || num_chars > TW_TEXT) {
+        dl_text(dl, text, num_chars, size, center, x, y, style, c);
+        return;
+    }
+    text_widget *w = find(tw, dl, size, center, x, y, style);
+    if (!w) {
+        dl_text(dl, text, num_chars, size, center, x, y, style, c);
+        return;
+    }
+    if (w->len != num_chars || memcmp(w->text, text, num_chars)) {
+        // new, or the string has changed
+        text_mask tm;
+        bf_sprite_free(&w->s);
+        w->x = x;
+        w->y = y;
+        w->size = size;
+        w->center = center;
+        w->style = style;
+        w->len = -1;
+        if (bf_text_mask(dl->target, text, num_chars, size, center, x, y, style, &tm)) {
+            return;
+        }
+        w->s.x = tm.x;
+        w->s.y = tm.y;
+        if (tm.mask && bf_sprite_pack(&w->s, tm.w, tm.h, tm.mask, NULL)) {
+            free(tm.mask);
+            return;
+        }
+        free(tm.mask);
+        memcpy(w->text, text, num_chars);
+        w->len = num_chars;
+    }
+    w->used = ++tw->clock;
+    w->frame = dl->frame;
+    if (w->s.row) {
+        dl_sprite(dl, 0, 0, &w->s, c);
+    }
+}
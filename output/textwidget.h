@@ -0,0 +1,42 @@
+// Text widgets, part of spectrum.
+//
+// Most text on screen is the same from one frame to the next. Each
+// place text is drawn, by position, size and style, is a widget that
+// keeps its rendered sprite, and renders again only when its string
+// changes; otherwise drawing it is a blit. Widgets not drawn for a
+// while give their slot to new ones.
+
+#pragma once
+
+#include <inttypes.h>
+
+#include "fbplot.h"
+#include "displaylist.h"
+
+#define TW_MAX 32       // widgets kept
+#define TW_TEXT 64      // longest string kept; longer ones are not
+
+typedef struct {
+    // where and how
+    uint32_t x, y;
+    int size, center, style;
+    // what
+    char text[TW_TEXT];
+    int len;
+    sprite s;
+    uint64_t used;      // when last drawn, for reuse of the slot
+    uint64_t frame;     // the display list frame it was last drawn in
+} text_widget;
+
+typedef struct {
+    text_widget w[TW_MAX];
+    int n;
+    uint64_t clock;
+} text_widgets;
+
+void tw_init(text_widgets *tw);
+
+void tw_free(text_widgets *tw);
+
+void tw_text(text_widgets *tw, display_list *dl, char *text, int num_chars, int size, int center,
+        uint32_t x, uint32_t y, int style, rgba c);
@@ -0,0 +1,71 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "overlay.h"
+
+#define OVERLAY_PERIOD 0.25     // s between updates of the figures
+
+static double seconds(struct timespec t) {
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+void overlay_init(overlay *o, pthread_t input) {
+    memset(o, 0, sizeof(*o));
+    o->has_input_clock = !pthread_getcpuclockid(input, &o->input_clock);
+    clock_gettime(CLOCK_MONOTONIC, &o->last);
+    o->next = o->last;
+    if (o->has_input_clock) {
+        struct timespec cpu;
+        clock_gettime(o->input_clock, &cpu);
+        o->input_cpu_s = seconds(cpu);
+    }
+}
+
+static void format(overlay *o, const pacer *pc, const timing *t, const struct audio_data *audio,
+        struct timespec now) {
+    // the figures since the last time
+    double input_cpu = 0;
+    if (o->has_input_clock) {
+        struct timespec cpu;
+        clock_gettime(o->input_clock, &cpu);
+        double wall = seconds(now) - seconds(o->last);
+        input_cpu = wall > 0 ? (seconds(cpu) - o->input_cpu_s) / wall : 0;
+        o->input_cpu_s = seconds(cpu);
+    }
+    o->last = now;
+
+    int n = 0;
+    snprintf(o->text[n++], OVERLAY_TEXT, "%5.1f fps  %lu late", pc->achieved_fps, pc->late);
+    for (int s = 0; s < STAGE_MAX; s++) {
+        if (t->h[s].n) {
+            snprintf(o->text[n++], OVERLAY_TEXT, "%-7s %6.2f ms", timing_stage_name(s), t->recent[s] * 1e3);
+        }
+    }
+    snprintf(o->text[n++], OVERLAY_TEXT, "input %3.0f%% cpu %3.0f%% fill", input_cpu * 100,
+            100 * audio->fill);
+    o->lines = n;
+}
+
+void overlay_draw(overlay *o, display_list *dl, text_widgets *tw, const overlay_layout *ol,
+        const pacer *pc, const timing *t, const struct audio_data *audio, rgba c) {
+    // on top of whatever has been recorded in dl
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (seconds(now) >= seconds(o->next)) {
+        format(o, pc, t, audio, now);
+        o->next = now;
+        o->next.tv_nsec += (long)(OVERLAY_PERIOD * 1e9);
+        if (o->next.tv_nsec >= 1000000000L) {
+            o->next.tv_sec++;
+            o->next.tv_nsec -= 1000000000L;
+        }
+    }
+
+    int top = ol->y + ol->line;
+    int bottom = ol->y - ol->line * o->lines + ol->line / 2;
+    dl_fill_rect(dl, 0, bottom, ol->w, top - bottom, rgba_to_pixel((rgba){0, 0, 0, 0}));
+    for (int i = 0; i < o->lines; i++) {
+        tw_text(tw, dl, o->text[i], strlen(o->text[i]), ol->font, false, ol->x, ol->y - ol->line * i, 0, c);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <pthread.h>
+#include <time.h>
+
+#include "pacer.h"
+#include "timing.h"
+#include "layout.h"
+#include "input/common.h"
+#include "output/displaylist.h"
+#include "output/textwidget.h"
+
+// Performance overlay.
+// A box of text over the vis with the frame rate, late frames, the
+// recent time of each frame stage, the CPU share of the input thread and
+// how much of the input buffer its last write filled. The figures are
+// formatted a few times a second, so in between the text widgets only
+// blit what they already hold.
+
+#define OVERLAY_LINES (STAGE_MAX + 2)
+#define OVERLAY_TEXT 40
+
+typedef struct {
+    clockid_t input_clock;      // CPU time of the input thread
+    int has_input_clock;
+    struct timespec next;       // when the text is formatted again
+    struct timespec last;       // when it was last
+    double input_cpu_s;         // the input thread's CPU time then
+    char text[OVERLAY_LINES][OVERLAY_TEXT];
+    int lines;
+} overlay;
+
+void overlay_init(overlay *o, pthread_t input);
+
+void overlay_draw(overlay *o, display_list *dl, text_widgets *tw, const overlay_layout *ol,
+        const pacer *pc, const timing *t, const struct audio_data *audio, rgba c);
@@ -0,0 +1,140 @@
+#include <math.h>
+#include <time.h>
+
+#include "pacer.h"
+#include "output/framebuffer.h"
+
+#include "debug.h"
+
+#define PACER_MIN_FPS 5.0
+#define PACER_WINDOW 32         // frames between adaptation decisions
+#define PACER_MAX_MISSED 4      // per window, before slowing down
+#define PACER_CLEAN 8           // clean windows before speeding up
+#define PACER_VSYNC_PROBES 4
+#define PACER_SMOOTH 0.05       // weight of a new sample in the averages
+
+static double seconds(struct timespec t) {
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static struct timespec now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t;
+}
+
+static void advance(struct timespec *t, double s) {
+    long ns = (long)(s * 1e9);
+    t->tv_sec += ns / 1000000000L;
+    t->tv_nsec += ns % 1000000000L;
+    if (t->tv_nsec >= 1000000000L) {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000L;
+    } else if (t->tv_nsec < 0) {
+        t->tv_sec--;
+        t->tv_nsec += 1000000000L;
+    }
+}
+
+static int vsync_blocks(void) {
+    // Back to back waits take a refresh period each if vsync works,
+    // nothing if the driver ignores it. Anything over 2ms a wait,
+    // i.e. a refresh rate under 500Hz, counts as working.
+    struct timespec t0 = now();
+    for (int i = 0; i < PACER_VSYNC_PROBES; i++) {
+        fb_vsync();
+    }
+    return seconds(now()) - seconds(t0) > PACER_VSYNC_PROBES * 2e-3;
+}
+
+void pacer_init(pacer *pc, double fps) {
+    pc->target_fps = fps;
+    pc->fps = fps;
+    pc->vsync = fps > 0 && vsync_blocks();
+    pc->frames = pc->missed = pc->clean = 0;
+    pc->achieved_fps = fps;
+    pc->jitter = 0;
+    pc->late = 0;
+    pacer_resync(pc);
+    debug("pacer: %.0f fps, vsync %s\n", fps, pc->vsync ? "blocks" : "does not block");
+}
+
+void pacer_resync(pacer *pc) {
+    pc->last = now();
+    pc->next = pc->last;
+    if (pc->fps > 0) {
+        advance(&pc->next, 1.0 / pc->fps);
+    }
+}
+
+static void adapt(pacer *pc, int late) {
+    // lower the rate when a window has too many misses,
+    // creep back up after a run of clean windows
+    pc->frames++;
+    pc->missed += late;
+    if (pc->frames < PACER_WINDOW) {
+        return;
+    }
+    if (pc->missed > PACER_MAX_MISSED) {
+        pc->clean = 0;
+        pc->fps = fmax(PACER_MIN_FPS, pc->fps * 0.8);
+        pacer_report(pc, stderr);
+    } else if (pc->missed == 0 && pc->fps < pc->target_fps && ++pc->clean >= PACER_CLEAN) {
+        pc->clean = 0;
+        pc->fps = fmin(pc->target_fps, pc->fps * 1.1);
+        pacer_report(pc, stderr);
+    }
+    pc->frames = pc->missed = 0;
+}
+
+double pacer_wait(pacer *pc) {
+    struct timespec t = now();
+    if (pc->target_fps <= 0) {
+        double dt = seconds(t) - seconds(pc->last);
+        pc->last = t;
+        pc->achieved_fps += PACER_SMOOTH * (1.0 / fmax(dt, 1e-6) - pc->achieved_fps);
+        return dt;
+    }
+    double period = 1.0 / pc->fps;
+    int late = seconds(t) > seconds(pc->next);
+
+    if (!late) {
+        if (pc->vsync) {
+            // sleep to within a refresh of the deadline, then catch the scan
+            struct timespec wake = pc->next;
+            advance(&wake, -fmin(period, 1.0 / 60));
+            if (seconds(wake) > seconds(t)) {
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+            }
+            fb_vsync();
+        } else {
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &pc->next, NULL);
+        }
+    } else {
+        pc->late++;
+    }
+    adapt(pc, late);
+
+    t = now();
+    double dt = seconds(t) - seconds(pc->last);
+    pc->last = t;
+    if (pc->vsync || late) {
+        // a frame boundary is wherever the scan or the work let us start
+        pc->next = t;
+    }
+    advance(&pc->next, period);
+
+    pc->achieved_fps += PACER_SMOOTH * (1.0 / fmax(dt, 1e-6) - pc->achieved_fps);
+    pc->jitter += PACER_SMOOTH * (fabs(dt - period) - pc->jitter);
+    return dt;
+}
+
+void pacer_report(const pacer *pc, FILE *f) {
+    if (pc->target_fps <= 0) {
+        fprintf(f, "pacer: %.1f fps achieved, unpaced\n", pc->achieved_fps);
+        return;
+    }
+    fprintf(f, "pacer: %.1f fps achieved, jitter %.2f ms, pacing at %.1f of %.1f fps%s, %lu late\n",
+            pc->achieved_fps, pc->jitter * 1e3, pc->fps, pc->target_fps,
+            pc->vsync ? " with vsync" : "", pc->late);
+}
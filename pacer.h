@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdio.h>
+#include <time.h>
+
+// Frame pacing.
+// Frames are timed against deadlines on CLOCK_MONOTONIC. Where the
+// driver's vsync really blocks it is used to line frames up with the
+// scan; where it returns at once the pacer sleeps to the deadline
+// instead of letting the loop spin. When too many deadlines are missed
+// the frame rate is lowered, and raised again once frames keep up.
+
+typedef struct {
+    double target_fps;      // as configured
+    double fps;             // currently paced rate, at most target_fps
+    int vsync;              // fb_vsync blocks
+    struct timespec next;   // deadline of the next frame
+    struct timespec last;   // start of the previous frame
+    int frames;             // frames in the current adaptation window
+    int missed;             // of which were late
+    int clean;              // windows in a row without a miss
+    // measured
+    double achieved_fps;    // smoothed rate of frames actually shown
+    double jitter;          // smoothed deviation from the frame period, s
+    unsigned long late;     // deadlines missed in total
+} pacer;
+
+// fps 0 does not pace: frames follow each other as fast as they are
+// made, for benchmarks.
+void pacer_init(pacer *pc, double fps);
+
+// Wait for the next frame; returns the seconds since the previous one.
+double pacer_wait(pacer *pc);
+
+// Start afresh from now, after a deliberate pause.
+void pacer_resync(pacer *pc);
+
+void pacer_report(const pacer *pc, FILE *f);
@@ -0,0 +1,30 @@
+#pragma once
+
+// Static probes, in builds configured with --enable-usdt.
+// Each is a nop in the code and a note in the binary until a tracer
+// attaches, e.g.
+//   bpftrace -e 'usdt:/usr/local/bin/spectrum:spectrum:frame_end { @[arg0 % 2] = count(); }'
+//   perf probe -x /usr/local/bin/spectrum sdt_spectrum:blit_start
+// The probes, all in the provider spectrum:
+//   frame_start(frame), frame_end(frame)   each frame, before the wait
+//                                          and after the render
+//   blit_start, blit_end                   the last frame to the screen
+//   fft_start(size), fft_end               both channels' FFTs
+//   input_block(index, rate)               new samples in the shmem ring
+//   config_reload                          the config file was read again
+
+#ifdef USDT
+
+#include <sys/sdt.h>
+
+#define PROBE(name) DTRACE_PROBE(spectrum, name)
+#define PROBE1(name, a) DTRACE_PROBE1(spectrum, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(spectrum, name, a, b)
+
+#else
+
+#define PROBE(name) ((void)0)
+#define PROBE1(name, a) ((void)0)
+#define PROBE2(name, a, b) ((void)0)
+
+#endif
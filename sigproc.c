@@ -8,6 +8,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <fftw3.h>
 #include <sys/types.h>
@@ -51,6 +52,50 @@ void window(struct audio_data *audio, int type) {
 }
 
 
+void monstercat(int *bins, int n, double strength) {
+    for (int z = 0; z < n; z++) {
+        for (int m_y = z - 1; m_y >= 0; m_y--) {
+            int de = z - m_y;
+            bins[m_y] = fmax(bins[z] / pow(strength, de), bins[m_y]);
+        }
+        for (int m_y = z + 1; m_y < n; m_y++) {
+            int de = m_y - z;
+            bins[m_y] = fmax(bins[z] / pow(strength, de), bins[m_y]);
+        }
+    }
+}
+
+bool ppm_level(const struct audio_data *audio, int n, double *peak_l, double *peak_r) {
+    double l = 0, r = 0;
+    bool clip = false;
+    int size = audio->FFTbufferSize;
+    int at = ((audio->index - n) % size + size) % size;
+    for (int k = 0; k < n; k++) {
+        int i = (at + k) % size;
+        l += fabs(audio->in_l[i]);
+        r += fabs(audio->in_r[i]);
+        // clip if very very close to max possible value
+        clip = clip || (fmax(fabs(audio->in_l[i]), fabs(audio->in_r[i])) >= ((2 << 15) - 2));
+    }
+    *peak_l = l / n;
+    *peak_r = r / n;
+    return clip;
+}
+
+// Copy the newest n samples of each channel to l and r, oldest first.
+// The inputs write the buffers as a ring at audio->index, so the seam is
+// there rather than at the end. The index is read once, so that both
+// channels come from the same moment.
+void ring_newest(const struct audio_data *audio, int n, double *l, double *r) {
+    int size = audio->FFTbufferSize;
+    int at = ((audio->index - n) % size + size) % size;
+    int first = min(n, size - at);
+    memcpy(l, audio->in_l + at, sizeof(double) * first);
+    memcpy(l + first, audio->in_l, sizeof(double) * (n - first));
+    memcpy(r, audio->in_r + at, sizeof(double) * first);
+    memcpy(r + first, audio->in_r, sizeof(double) * (n - first));
+}
+
 // bin together power spectrum in dB
 int *make_bins(struct audio_data *audio,
         int number_of_bins,
@@ -100,3 +145,46 @@ int *make_bins(struct audio_data *audio,
     }
     return bins;
 }
+
+
+// Start of the last span samples of data that begin where the signal
+// rises through zero, having been below -level, so that the waveform
+// stands still from one frame to the next. The search runs back from
+// the newest such start and gives up after about span samples, so its
+// cost does not grow with n; if there is no crossing in that stretch
+// the newest span samples are used.
+int scope_trigger(const double *data, int n, int span, double level) {
+    int stop = max(1, n - 2 * span);
+    for (int i = n - span; i >= stop; i--) {
+        if (data[i - 1] < 0 && data[i] >= 0) {
+            // armed if the negative half cycle before it reached -level
+            int j = i - 1;
+            while (j >= stop && data[j] < 0 && data[j] >= -level) {
+                j--;
+            }
+            if (data[j] < -level) {
+                return i;
+            }
+            i = j + 1;
+        }
+    }
+    return n - span;
+}
+
+// Decimate n samples of data to cols columns, each kept as the least
+// and greatest sample falling in it, env[2 * c] and env[2 * c + 1].
+// The reductions are selects rather than fmin/fmax, which must handle
+// NaN, so that they compile to branch-free min/max instructions.
+void scope_envelope(const double *data, int n, int cols, double *env) {
+    for (int c = 0; c < cols; c++) {
+        int i0 = (int)((long)n * c / cols);
+        int i1 = max((int)((long)n * (c + 1) / cols), i0 + 1);
+        double lo = data[i0], hi = data[i0];
+        for (int i = i0 + 1; i < i1; i++) {
+            lo = data[i] < lo ? data[i] : lo;
+            hi = data[i] > hi ? data[i] : hi;
+        }
+        env[2 * c] = lo;
+        env[2 * c + 1] = hi;
+    }
+}
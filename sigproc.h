@@ -14,6 +14,20 @@
 
 void window(struct audio_data *audio, int type);
 
+// Spreads each bar into its neighbours, falling by strength per bar.
+void monstercat(int *bins, int n, double strength);
+
+// The mean absolute level of each channel over the newest n samples.
+// Returns true if any sample was at full scale.
+bool ppm_level(const struct audio_data *audio, int n, double *peak_l, double *peak_r);
+
+// The newest n samples of each channel into l and r, in time order.
+void ring_newest(const struct audio_data *audio, int n, double *l, double *r);
+
 int *make_bins(struct audio_data *audio,
         int number_of_bins,
         int channel);
+
+int scope_trigger(const double *data, int n, int span, double level);
+
+void scope_envelope(const double *data, int n, int cols, double *env);
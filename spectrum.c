@@ -21,23 +21,39 @@
 #include <signal.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
 //#include <unistd.h>
 
 #include "debug.h"
+#include "util.h"
 #include "config.h"
 #include "sigproc.h"
+#include "pacer.h"
+#include "timing.h"
+#include "overlay.h"
+#include "metrics.h"
+#include "trace.h"
+#include "probes.h"
+#include "layout.h"
 
 #include "input/common.h"
 #include "input/alsa.h"
 #include "input/fifo.h"
 #include "input/pulse.h"
 #include "input/shmem.h"
+#include "input/synth.h"
 #include "input/sndio.h"
 
 #include "output/fbplot.h"
+#include "output/displaylist.h"
+#include "output/renderpool.h"
+#include "output/needle.h"
+#include "output/skin.h"
+#include "output/textwidget.h"
+#include "output/backlight.h"
 
 #ifdef __GNUC__
 // curses.h or other sources may already define
@@ -47,17 +63,34 @@
 #define GCC_UNUSED /* nothing */
 #endif
 
+// steps of the idle clock, 0.3 s apart, over which the last frame fades
+#define IDLE_FADE_STEPS 120
+// the oscilloscope's smallest full scale, so silence is not blown up
+#define SCOPE_MIN_PEAK 256
+
+// --bench runs each vis in turn for an equal share of the time; ppm
+// first, so that its needles are made at startup as they would be
+static const char *bench_vis[] = {"ppm", "fft", "pcm"};
+#define BENCH_VIS (sizeof(bench_vis) / sizeof(bench_vis[0]))
+
 
 bool clean_exit = false;
+volatile sig_atomic_t report_timing = 0;
+volatile sig_atomic_t toggle_overlay = 0;
 struct config_params p;
 
 // general: handle signals
 void sig_handler(int sig_no) {
     if (sig_no == SIGUSR1) {
+        // print the frame stage timings after this frame, and write
+        // the trace in builds that record one
+        report_timing = 1;
         return;
     }
 
     if (sig_no == SIGUSR2) {
+        // show or hide the performance overlay
+        toggle_overlay = 1;
         return;
     }
 
@@ -72,17 +105,19 @@ void sig_handler(int sig_no) {
 }
 
 // config: reloader
-void check_config_changed(char *configPath,
+// mtime of the config as last loaded, so that only edits reload it
+static time_t config_mtime = 0;
+
+int check_config_changed(char *configPath,
         rgba *plot_l_c, rgba *plot_r_c,
         rgba *ax_c, rgba *ax2_c,
         rgba *text_c, rgba *audio_c) {
     // reload if config file has been modified
     struct stat config_stat;
-    static time_t last_time = 0;
     int err = stat(configPath, &config_stat);
     if (!err) {
-        if (last_time != config_stat.st_mtime) {
-            last_time = config_stat.st_mtime;
+        if (config_mtime != config_stat.st_mtime) {
+            config_mtime = config_stat.st_mtime;
             debug("config file has been modified, reloading\n");
             struct error_s error;
             error.length = 0;
@@ -93,6 +128,10 @@ void check_config_changed(char *configPath,
                 // config: font
                 freetype_cleanup();
                 freetype_init(p.text_font, p.audio_font);
+                if (p.sdf_text && freetype_sdf(p.text_font, p.audio_font, p.sdf_cache)) {
+                    fprintf(stderr, "could not make the distance field fonts\n");
+                }
+                bf_set_antialias(p.antialias);
                 // config: plot colours
                 uint32_t r, g, b;
                 sscanf(p.plot_l_col, "#%02x%02x%02x", &r, &g, &b);
@@ -107,9 +146,69 @@ void check_config_changed(char *configPath,
                 text_c->r = r; text_c->g = g; text_c->b = b;
                 sscanf(p.audio_col, "#%02x%02x%02x", &r, &g, &b);
                 audio_c->r = r; audio_c->g = g; audio_c->b = b;
+                return 1;
             }
         }
     }
+    return 0;
+}
+
+void skin_init(skin *sk, const char *configPath) {
+    // the skin's pictures, decoded once and cached beside the config
+    char cache[PATH_MAX + 16];
+    const char *slash = strrchr(configPath, '/');
+    int dir = slash ? (int)(slash - configPath + 1) : 0;
+    snprintf(cache, sizeof(cache), "%.*sskin.cache", dir, configPath);
+    if (skin_load(sk, p.skin, p.needle_image, cache)) {
+        fprintf(stderr, "could not load the skin %s %s\n", p.skin, p.needle_image);
+    }
+}
+
+void draw_face(display_list *dl, const skin *sk) {
+    // the skin's face, or a clear screen
+    if (sk->face.pixels) {
+        dl_paste(dl, sk->face);
+    } else {
+        dl_clear(dl);
+    }
+}
+
+void needle_init(needle_cache *nc, skin *sk, const layout *lay, double l0, double l1, double r0, double r1) {
+    // Render the needles of the ppm meters for the angles l0 to l1
+    // and r0 to r1. If there is no cache nc->n is 0, and the needles
+    // are drawn as rays. The cache takes the skin's needle.
+    const ppm_layout *lp = &lay->ppm;
+    memset(nc, 0, sizeof(*nc));
+    if (p.needle_step <= 0) {
+        return;
+    }
+    if (sk->needle.pixels) {
+        image img = sk->needle;
+        memset(&sk->needle, 0, sizeof(sk->needle));
+        double px = p.needle_pivot_x >= 0 ? p.needle_pivot_x : 0;
+        double py = p.needle_pivot_y >= 0 ? p.needle_pivot_y : img.h / 2.0;
+        if (nc_init_image(nc, p.needle_step, img, px, py, lay->scale)) {
+            return;
+        }
+    } else {
+        if (nc_init_ray(nc, p.needle_step, lp->needle_in, lp->needle_out, lp->needle_w)) {
+            return;
+        }
+    }
+    if (!strcmp(p.vis, "ppm")) {
+        nc_prepare(nc, l0, l1);
+        nc_prepare(nc, r0, r1);
+    }
+}
+
+void draw_needle(display_list *dl, needle_cache *nc, const ppm_layout *lp, int x0, int y0, double theta, rgba c) {
+    // the sprite nearest theta, or a ray if there is none
+    const sprite *s = nc->n ? nc_sprite(nc, theta) : NULL;
+    if (s) {
+        dl_sprite(dl, x0, y0, s, c);
+    } else {
+        dl_draw_ray(dl, x0, y0, lp->needle_in, lp->needle_out, theta, lp->needle_w, c);
+    }
 }
 
 int main(int argc, char **argv) {
@@ -121,8 +220,10 @@ Usage : " PACKAGE " [options]\n\
 Visualize audio input on the framebuffer. \n\
 \n\
 Options:\n\
-	-p          path to config file\n\
-	-v          print version\n\
+	-p, --config PATH      path to config file\n\
+	-b, --bench SECONDS    time every vis on synthetic input, rendering\n\
+	                       off screen as fast as it can, and exit\n\
+	-v, --version          print version\n\
 \n\
 All options are specified in config file, see in '/home/username/.config/spectrum/' \n";
 
@@ -136,14 +237,34 @@ All options are specified in config file, see in '/home/username/.config/spectru
     sigaction(SIGUSR2, &action, NULL);
 
     // general: handle command-line arguments
-    int c;
+    int opt;
     char configPath[PATH_MAX];
     configPath[0] = '\0';
-    while ((c = getopt(argc, argv, "p:vh")) != -1) {
-        switch (c) {
+    double bench = 0;
+    static const struct option options[] = {
+        {"config", required_argument, NULL, 'p'},
+        {"bench", required_argument, NULL, 'b'},
+        {"version", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    while ((opt = getopt_long(argc, argv, "p:b:vh", options, NULL)) != -1) {
+        switch (opt) {
         case 'p': // argument: fifo path
             snprintf(configPath, sizeof(configPath), "%s", optarg);
             break;
+        case 'b': // argument: benchmark seconds
+#ifndef NDEBUG
+            // debug builds skip drawing, so there would be nothing to time
+            fprintf(stderr, "--bench needs a build without --enable-debug\n");
+            return EXIT_FAILURE;
+#endif
+            bench = atof(optarg);
+            if (bench <= 0) {
+                fprintf(stderr, "--bench needs a number of seconds\n");
+                return EXIT_FAILURE;
+            }
+            break;
         case 'h': // argument: print usage
             printf("%s", usage);
             return EXIT_FAILURE;
@@ -166,9 +287,27 @@ All options are specified in config file, see in '/home/username/.config/spectru
         fprintf(stderr, "Error loading config. %s", error.message);
         exit(EXIT_FAILURE);
     }
+    struct stat config_stat;
+    if (!stat(configPath, &config_stat)) {
+        config_mtime = config_stat.st_mtime;
+    }
+    if (bench > 0) {
+        // the config's screen size and look, but rendered to memory,
+        // unpaced and from the synthetic input
+        p.om = OUTPUT_HEADLESS;
+        p.dump = FB_DUMP_NONE;
+        p.fps = 0;
+        p.idle_blank = 0;
+        free(p.vis);
+        p.vis = strdup(bench_vis[0]);
+    }
 
     // config: font
     freetype_init(p.text_font, p.audio_font);
+    if (p.sdf_text && freetype_sdf(p.text_font, p.audio_font, p.sdf_cache)) {
+        fprintf(stderr, "could not make the distance field fonts\n");
+    }
+    bf_set_antialias(p.antialias);
 
     // config: plot colours
     uint32_t r, g, b, a=0;
@@ -188,25 +327,25 @@ All options are specified in config file, see in '/home/username/.config/spectru
 
     /*** set up framebuffer display ***/
 
-    // left channel axes
-    axes ax_l;
-    ax_l.screen_x = 0;
-    ax_l.screen_y = 0;
-    ax_l.screen_w = FRAMEBUFFER_WIDTH - 1;
-    ax_l.screen_h = FRAMEBUFFER_HEIGHT;
-    ax_l.x_min = log10(LOWER_CUTOFF_FREQ);
-    ax_l.x_max = log10(UPPER_CUTOFF_FREQ);
-    ax_l.y_min = -1000;    // dB
-    ax_l.y_max = 500;
-
-    // right channel axes are an offset copy of the left
-    axes ax_r = ax_l;
-    ax_r.screen_x = 1; // offset so l/r channels alternate pixels
-
-    int number_of_bars = 30; //ax_l.screen_w / 2;
-
     // framebuffer plotting init
-    fb_setup();
+    fb_options fbo = {
+        .headless = p.om == OUTPUT_HEADLESS,
+        .device = p.fb_device,
+        .width = p.fb_width,
+        .height = p.fb_height,
+        .bpp = p.fb_bpp,
+        .dither = p.dither,
+        .dump = p.dump,
+        .dump_path = p.dump_path,
+    };
+    if (fb_setup(&fbo)) {
+        fprintf(stderr, "could not open the %s output\n", fbo.headless ? "headless" : p.fb_device);
+        exit(EXIT_FAILURE);
+    }
+    fb_set_orientation(p.rotate, p.flip_x, p.flip_y);
+    if (!bl_init(p.backlight) && p.brightness >= 0) {
+        bl_set_brightness(p.brightness);
+    }
     fb_clear();
 
     buffer buffer_final;
@@ -215,6 +354,37 @@ All options are specified in config file, see in '/home/username/.config/spectru
     buffer buffer_clock;
     bf_init(&buffer_clock);
 
+    // layout for the screen size
+    layout lay;
+    layout_init(&lay, buffer_final.w, buffer_final.h);
+    const fft_layout *lf = &lay.fft;
+    const ppm_layout *lp = &lay.ppm;
+
+    // left channel axes
+    axes ax_l = lf->ax;
+
+    // right channel axes are an offset copy of the left
+    axes ax_r = ax_l;
+    ax_r.screen_x = 1; // offset so l/r channels alternate pixels
+
+    int number_of_bars = lf->bars;
+
+    // oscilloscope axes and a min/max envelope per column
+    axes ax_s = lf->ax;
+    int scope_cols = (int)ax_s.screen_w;
+    double *scope_l = calloc(2 * scope_cols, sizeof(double));
+    double *scope_r = calloc(2 * scope_cols, sizeof(double));
+    double scope_peak = SCOPE_MIN_PEAK;
+
+    // the vis records into dl, which the pool draws into buffer_final
+    display_list dl;
+    dl_init(&dl, buffer_final);
+    render_pool pool;
+    rp_init(&pool, p.render_threads);
+    // text that is mostly the same each frame
+    text_widgets texts;
+    tw_init(&texts);
+
     /*** set up audio processing ***/
 
     struct audio_data audio;
@@ -237,6 +407,9 @@ All options are specified in config file, see in '/home/username/.config/spectru
     audio.in_l = fftw_alloc_real(2 * (audio.FFTbufferSize / 2 + 1));
     memset(audio.in_r, 0, 2 * (audio.FFTbufferSize / 2 + 1) * sizeof(double));
     memset(audio.in_l, 0, 2 * (audio.FFTbufferSize / 2 + 1) * sizeof(double));
+    // the oscilloscope's copy of the newest samples, in time order
+    double *scope_in_l = calloc(audio.FFTbufferSize, sizeof(double));
+    double *scope_in_r = calloc(audio.FFTbufferSize, sizeof(double));
 
     audio.windowed_r = fftw_alloc_real(2 * (audio.FFTbufferSize / 2 + 1));
     audio.windowed_l = fftw_alloc_real(2 * (audio.FFTbufferSize / 2 + 1));
@@ -263,7 +436,7 @@ All options are specified in config file, see in '/home/username/.config/spectru
 
     int sourceIsAuto = 1;
     // Input is shared memory from squeezelite on this box
-    thr_id = pthread_create(&p_thread, NULL, input_shmem, (void *)&audio);
+    thr_id = pthread_create(&p_thread, NULL, bench > 0 ? input_synth : input_shmem, (void *)&audio);
 
     int n = 0;
 
@@ -286,11 +459,9 @@ All options are specified in config file, see in '/home/username/.config/spectru
     time_t now;
     time_t n1;
     struct tm *info;
-    clock_t fps_timer = 10;
-    clock_t last_fps_timer = 11;
-    double fps = 30;
     char textstr[80];
     char timestr[80];
+    time_t date_minute = -1;
     int length;
     double peak_dB = -10.0;
     double peak_l = 0, peak_r = 0;
@@ -298,23 +469,82 @@ All options are specified in config file, see in '/home/username/.config/spectru
     uint32_t l_pos = 0;
     uint32_t r_pos = 0;
 
+    // ppm dials
+    //double max_angle = 45;
+    //double min_angle = 135;
+    double max_angle = 60;
+    double min_angle = -60;
+    double max_angle_r = 120;
+    double min_angle_r = 240;
+
+    double max_dB = 5;
+    double min_dB = -50;
+    // Linear relation between dB and angle: theta = m*dB + c.
+    double m = (max_angle - min_angle) / (max_dB - min_dB);
+    double c = max_angle - m * max_dB;
+
+    double m_r = (max_angle_r - min_angle_r) / (max_dB - min_dB);
+    double c_r = max_angle_r - m_r * max_dB;
+
+    // the needles, pre-rendered over the angles they sweep
+    skin sk;
+    skin_init(&sk, configPath);
+    needle_cache needle;
+    needle_init(&needle, &sk, &lay, min_dB * m + c, max_dB * m + c, min_dB * m_r + c_r, max_dB * m_r + c_r);
+
+    pacer pacer;
+    pacer_init(&pacer, p.fps);
+    timing timing;
+    timing_init(&timing);
+    if (p.perf_counters) {
+        timing_counters(&timing);
+    }
+    overlay overlay;
+    overlay_init(&overlay, p_thread);
+    int show_overlay = p.overlay;
+    metrics metrics;
+    if (metrics_init(&metrics, p.metrics_socket)) {
+        fprintf(stderr, "could not serve metrics on %s\n", p.metrics_socket);
+    }
+    uint64_t frames = 0, ffts = 0;
+
+    // idle mode, while audio is paused; blanked is -1 if the panel
+    // could not be turned off
+    int idle = 0, idle_fade = 0, blanked = 0;
+    time_t idle_since = 0, idle_minute = -1;
+
+    // --bench: the vis being timed, since when and from which frame
+    size_t bench_mode = 0;
+    uint64_t bench_frames = 0;
+    struct timespec bench_begin, bench_mark;
+    clock_gettime(CLOCK_MONOTONIC, &bench_begin);
+    bench_mark = bench_begin;
+
     time(&n1);
+    trace_thread("main");
 
     while (!clean_exit) {
 
         time(&now);
-        last_fps_timer = fps_timer;
-        fps_timer = clock();
-        double dt = (double)(fps_timer - last_fps_timer) / CLOCKS_PER_SEC;
 
         // if config file is modified, reloads every 10s
 
-        if ((now % 10) == 0) {
+        if ((now % 10) == 0 && bench <= 0) {
           if ( now - n1 > 1) {
-            check_config_changed(configPath,
+            if (check_config_changed(configPath,
                     &plot_l_c, &plot_r_c,
                     &ax_c, &ax2_c,
-                    &text_c, &audio_c);
+                    &text_c, &audio_c)) {
+                trace_instant("reload");
+                PROBE(config_reload);
+                // fonts, antialiasing, the skin or the needle may have changed
+                tw_free(&texts);
+                nc_free(&needle);
+                skin_free(&sk);
+                skin_init(&sk, configPath);
+                show_overlay = p.overlay;
+                needle_init(&needle, &sk, &lay, min_dB * m + c, max_dB * m + c, min_dB * m_r + c_r, max_dB * m_r + c_r);
+            }
 
              time(&n1);
           } 
@@ -323,38 +553,88 @@ All options are specified in config file, see in '/home/username/.config/spectru
 #ifdef NDEBUG
         // framebuffer vis
 
-        // wait for screen to be ready
-        fb_vsync();
-        bf_blit(buffer_final);
-
         if (!audio.running) {
-            // if audio is paused wait and continue
-            // show a clock, screensaver or something
-            bf_clear(buffer_clock);
+            // If audio is paused show a clock. The last frame fades into
+            // it, after which the screen only changes with the minute,
+            // and after idle_blank seconds the panel is turned off.
             time(&now);
-            length = strftime(textstr, sizeof(textstr), "%H:%M", localtime(&now));
-            bf_text(buffer_clock, textstr, length, 64, true, 0, 200, 1, text_c);
-            length = strftime(textstr, sizeof(textstr), "%a, %d %B %Y", localtime(&now));
-            bf_text(buffer_clock, textstr, length, 14, true, 0, 80, 1, text_c);
-            bf_blend(buffer_final, buffer_clock, 0.98);
-            //bf_blit(buffer_clock);
+            if (!idle) {
+                idle = 1;
+                idle_since = now;
+                idle_fade = IDLE_FADE_STEPS;
+                idle_minute = -1;
+            }
+            int dirty = 0;
+            if (now / 60 != idle_minute) {
+                idle_minute = now / 60;
+                bf_clear(buffer_clock);
+                length = strftime(textstr, sizeof(textstr), "%H:%M", localtime(&now));
+                bf_text(buffer_clock, textstr, length, lay.clock.font_time, true, 0, lay.clock.time_y, 1, text_c);
+                length = strftime(textstr, sizeof(textstr), "%a, %d %B %Y", localtime(&now));
+                bf_text(buffer_clock, textstr, length, lay.clock.font_date, true, 0, lay.clock.date_y, 1, text_c);
+                if (!idle_fade) {
+                    bf_copy(buffer_final, buffer_clock);
+                }
+                dirty = 1;
+            }
+            if (idle_fade) {
+                // rounding stalls the fade short of the clock, so finish it
+                if (--idle_fade) {
+                    bf_blend(buffer_final, buffer_clock, 0.98);
+                } else {
+                    bf_copy(buffer_final, buffer_clock);
+                }
+                dirty = 1;
+            }
+            if (p.idle_blank > 0 && !blanked && now - idle_since >= p.idle_blank) {
+                blanked = fb_blank(1) ? -1 : 1;
+            }
+            if (dirty && blanked <= 0) {
+                bf_blit(buffer_final);
+            }
 
             // wait, then check if running again.
             struct timespec sleep_mode_timer = {.tv_sec = 0, .tv_nsec = 3e8};
             nanosleep(&sleep_mode_timer, NULL);
+            pacer_resync(&pacer);
             continue;
+        }
+        if (idle) {
+            idle = 0;
+            if (blanked > 0) {
+                fb_blank(0);
+            }
+            blanked = 0;
+        }
+
+        // wait for the next frame, then show the last one
+        timing_start(&timing);
+        PROBE1(frame_start, frames);
+        double dt = pacer_wait(&pacer);
+        timing_stage(&timing, STAGE_WAIT);
+        PROBE(blit_start);
+        bf_blit(buffer_final);
+        PROBE(blit_end);
+        timing_stage(&timing, STAGE_BLIT);
+        dl_reset(&dl);
 
-        } else if (!strcmp("fft", p.vis)) {
+        if (!strcmp("fft", p.vis)) {
 
             // window, execute FFT
             window(&audio, HANN);
             //window(&audio, BLAC);
+            timing_stage(&timing, STAGE_WINDOW);
+            PROBE1(fft_start, audio.FFTbufferSize);
             fftw_execute(p_l);
             fftw_execute(p_r);
+            PROBE(fft_end);
+            ffts += 2;
+            timing_stage(&timing, STAGE_FFT);
 
             // integrate power
             int *bins_left = make_bins(&audio, number_of_bars, LEFT_CHANNEL); 
             int *bins_right = make_bins(&audio, number_of_bars, RIGHT_CHANNEL); 
+            timing_stage(&timing, STAGE_BINS);
 
             // FFT plotter to framebuffer
             // set plotting axes
@@ -368,31 +648,18 @@ All options are specified in config file, see in '/home/username/.config/spectru
             }
 
             // monstercat smoothing
-            int z,m_y,de;
-            double monstercat = 5;
-
-            for (z = 0; z < number_of_bars; z++) { 
-              for (m_y = z - 1; m_y >= 0; m_y--) {
-                de = z - m_y;
-                bins_left[m_y] = fmax(bins_left[z] / pow(monstercat,de), bins_left[m_y]);
-                bins_right[m_y] = fmax(bins_right[z] / pow(monstercat,de), bins_right[m_y]);
-              }
-
-              for (m_y = z + 1; m_y < number_of_bars; m_y++) {
-                de = m_y - z;
-                bins_left[m_y] = fmax(bins_left[z] / pow(monstercat,de), bins_left[m_y]);
-                bins_right[m_y] = fmax(bins_right[z] / pow(monstercat,de), bins_right[m_y]);
-              }
-            }
+            monstercat(bins_left, number_of_bars, 5);
+            monstercat(bins_right, number_of_bars, 5);
+            timing_stage(&timing, STAGE_SMOOTH);
 
 //            bf_shade(buffer_final, p.alpha);
-            bf_clear(buffer_final);
+            draw_face(&dl, &sk);
             // plot spectrum
-            //bf_plot_bars(buffer_final, ax_l, bins_right, number_of_bars, plot_l_c);
-            //bf_plot_bars(buffer_final, ax_r, bins_left, number_of_bars, plot_r_c);
-            bf_plot_bars(buffer_final, ax_l, bins_right, number_of_bars, bar_c);
-            bf_plot_bars(buffer_final, ax_r, bins_left, number_of_bars, bar_c);
-            bf_plot_axes(buffer_final, ax_l, ax_c, ax_c);
+            //dl_plot_bars(&dl, ax_l, bins_right, number_of_bars, plot_l_c);
+            //dl_plot_bars(&dl, ax_r, bins_left, number_of_bars, plot_r_c);
+            dl_plot_bars(&dl, ax_l, bins_right, number_of_bars, bar_c);
+            dl_plot_bars(&dl, ax_r, bins_left, number_of_bars, bar_c);
+            dl_plot_axes(&dl, ax_l, ax_c, ax_c);
 
             for (int n = 0; n < audio.FFTbufferSize; n++) {
                 ax_l.y_max = fmax(ax_l.y_max, audio.in_l[n]/100);
@@ -400,19 +667,7 @@ All options are specified in config file, see in '/home/username/.config/spectru
 
             // PPM
             // peak_l and peak_r are averaged over last 5ms
-            peak_l = 0;
-            peak_r = 0;
-            bool clip = false;
-            int num_samples = (int)(5.0 * (double)audio.rate / 1000.0);
-            for (int n = 0; n < num_samples; n++) {
-                int i = (n + audio.index) % audio.FFTbufferSize;
-                peak_l += fabs(audio.in_l[i]);
-                peak_r += fabs(audio.in_r[i]);
-                // clip if very very close to max possible value
-                clip = clip || (fmax(fabs((double)audio.in_l[i]), fabs((double)audio.in_r[i])) >= ((2 << 15) - 2));
-            }
-            peak_l /= num_samples;
-            peak_r /= num_samples;
+            ppm_level(&audio, (int)(5.0 * (double)audio.rate / 1000.0), &peak_l, &peak_r);
             // Audio came from a signed 16-bit int, so clipping occurs at < 90.3dB.
             // The scale is defined with 0dB relative to 10dB headroom.
             // As such, subtract absolute 81dB so that instantaneous +10dB on
@@ -426,84 +681,64 @@ All options are specified in config file, see in '/home/username/.config/spectru
             ppm_r = exp(-1.3545 * dt) * ppm_r + fmax(20 * log10(peak_r) - 80.3, min_dB) * dt;
 
 
-            l_pos = abs((ax_l.screen_w-160)-abs(ppm_l)*15)+60;
-            r_pos = abs((ax_l.screen_w-160)-abs(ppm_r)*15)+60;
-            bf_text(buffer_final,"L",1,8,false,20,80,0,audio_c);
-            bf_draw_line(buffer_final, 60, 85, l_pos, 85, bar_c);
-            bf_text(buffer_final,"R",1,8,false,20,40,0,audio_c);
-            bf_draw_line(buffer_final, 60, 45, r_pos, 45, bar_c);
+            l_pos = fabs(lf->meter_len - fabs(ppm_l) * lf->meter_dB) + lf->meter_x;
+            r_pos = fabs(lf->meter_len - fabs(ppm_r) * lf->meter_dB) + lf->meter_x;
+            tw_text(&texts, &dl, "L", 1, lf->font, false, lf->label_x, lf->meter_l_y - lf->meter_h / 2, 0, audio_c);
+            dl_fill_rect(&dl, lf->meter_x, lf->meter_l_y, l_pos - lf->meter_x + 1, lf->meter_h, rgba_to_pixel(bar_c));
+            tw_text(&texts, &dl, "R", 1, lf->font, false, lf->label_x, lf->meter_r_y - lf->meter_h / 2, 0, audio_c);
+            dl_fill_rect(&dl, lf->meter_x, lf->meter_r_y, r_pos - lf->meter_x + 1, lf->meter_h, rgba_to_pixel(bar_c));
 
-            if( (now % 1) == 0 ) {
+            if (now / 60 != date_minute) {
+              date_minute = now / 60;
               info = localtime(&now);
               strftime(timestr,80,"%a,  %b  %d  %I:%M %p", info);
-              bf_text(buffer_final,timestr,strlen(timestr),9,false,60,10,0,audio_c);
             }
+            tw_text(&texts, &dl, timestr, strlen(timestr), lf->font_info, false, lf->date_x, lf->date_y, 0, audio_c);
           
             sprintf(textstr, "%+03.1f  ", ppm_r);
-            bf_text(buffer_final, textstr, 5, 8, false, ax_l.screen_w - 60, 80, 0, audio_c);
+            tw_text(&texts, &dl, textstr, 5, lf->font, false, lf->reading_x, lf->meter_l_y - lf->meter_h / 2, 0, audio_c);
             sprintf(textstr, "%+03.1f  ", ppm_l);
-            bf_text(buffer_final, textstr, 5, 8, false, ax_l.screen_w - 60, 40, 0, audio_c);
+            tw_text(&texts, &dl, textstr, 5, lf->font, false, lf->reading_x, lf->meter_r_y - lf->meter_h / 2, 0, audio_c);
    
             sprintf(textstr, "%4.1fkHz", (double)audio.rate / 1000);
-            bf_text(buffer_final, textstr, 7, 9, false, 710, 10, 0, audio_c);
+            tw_text(&texts, &dl, textstr, 7, lf->font_info, false, lf->rate_x, lf->rate_y, 0, audio_c);
 
 	    //bf_blit(buffer_final);
-            //bf_clear(buffer_final);
+            //dl_clear(&dl);
             
         } else if (!strcmp("pcm", p.vis)) {
-            // waveform plotter to framebuffer
-            // set plotting axes
-            for (int n = 0; n < audio.FFTbufferSize; n++) {
-                //int i = (n + audio.index) % audio.FFTbufferSize;
-                ax_l.y_max = fmax(ax_l.y_max, audio.in_l[n]);
-                ax_l.y_min = fmin(ax_l.y_min, audio.in_l[n]);
-                ax_l.y_max = fmax(ax_l.y_max, audio.in_r[n]);
-                ax_l.y_min = fmin(ax_l.y_min, audio.in_r[n]);
-                ax_r.y_max = ax_l.y_max;
-                ax_r.y_min = ax_l.y_min;
+            // oscilloscope: the newest scope_ms of both channels from a
+            // rising zero crossing of the left, a min/max pair per column;
+            // the trigger is looked for in the span before the newest
+            int n = audio.FFTbufferSize;
+            int span = min(n / 2, max(1, (int)(p.scope_ms * audio.rate / 1000)));
+            ring_newest(&audio, 2 * span, scope_in_l, scope_in_r);
+            int start = scope_trigger(scope_in_l, 2 * span, span, 0.05 * scope_peak);
+            scope_envelope(scope_in_l + start, span, scope_cols, scope_l);
+            scope_envelope(scope_in_r + start, span, scope_cols, scope_r);
+
+            // full scale follows the peak up at once, down over seconds
+            double peak = SCOPE_MIN_PEAK;
+            for (int i = 0; i < 2 * scope_cols; i++) {
+                peak = fmax(peak, fmax(fabs(scope_l[i]), fabs(scope_r[i])));
             }
+            scope_peak = fmax(peak, scope_peak * exp(-dt));
+            ax_s.y_max = 1.1 * scope_peak;
+            ax_s.y_min = -ax_s.y_max;
 
             // plot waveform
-            bf_clear(buffer_final);
-            bf_plot_line(buffer_final, ax_l, audio.in_l, audio.FFTbufferSize, plot_l_c);
-            bf_plot_line(buffer_final, ax_r, audio.in_r, audio.FFTbufferSize, plot_r_c);
+            draw_face(&dl, &sk);
+            dl_plot_scope(&dl, ax_s, scope_l, scope_cols, plot_l_c);
+            dl_plot_scope(&dl, ax_s, scope_r, scope_cols, plot_r_c);
 
         } else {
             // PPM
             // peak_l and peak_r are averaged over last 5ms
-            peak_l = 0;
-            peak_r = 0;
-            bool clip = false;
-            int num_samples = (int)(5.0 * (double)audio.rate / 1000.0);
-            for (int n = 0; n < num_samples; n++) {
-                int i = (n + audio.index) % audio.FFTbufferSize;
-                peak_l += fabs(audio.in_l[i]);
-                peak_r += fabs(audio.in_r[i]);
-                // clip if very very close to max possible value
-                clip = clip || (fmax(fabs((double)audio.in_l[i]), fabs((double)audio.in_r[i])) >= ((2 << 15) - 2));
-            }
-            peak_l /= num_samples;
-            peak_r /= num_samples;
+            bool clip = ppm_level(&audio, (int)(5.0 * (double)audio.rate / 1000.0), &peak_l, &peak_r);
             // Audio came from a signed 16-bit int, so clipping occurs at < 90.3dB.
             // The scale is defined with 0dB relative to 10dB headroom.
             // As such, subtract absolute 81dB so that instantaneous +10dB on
             // the scale is where clipping occurs.
-            //double max_angle = 45;
-            //double min_angle = 135;
-            double max_angle = 60;
-            double min_angle = -60;
-            double max_angle_r = 120;
-            double min_angle_r = 240;
-
-            double max_dB = 5;
-            double min_dB = -50;
-            // Linear relation between dB and angle: theta = m*dB + c.
-            double m = (max_angle - min_angle) / (max_dB - min_dB);
-            double c = max_angle - m * max_dB;
-
-            double m_r = (max_angle_r - min_angle_r) / (max_dB - min_dB);
-            double c_r = max_angle_r - m_r * max_dB;
-
             // Physical dynamics of ppm meters:
             // the pole at -1.3545 corresponds to 20dB decay / 1.7s
             // as per Type I IEC 60268-10 (DIN PPM) spec.
@@ -514,99 +749,135 @@ All options are specified in config file, see in '/home/username/.config/spectru
             //double angle_r = ppm_r * m + c;
             double angle_r = ppm_r * m_r + c_r;
             // Draw left and right needles on one dial.
-            //int r = 320;                        // needle radius
-            int r = 180;
-//            int x0 = (int)buffer_final.w / 2;   // needle origin (x)
-            int x0 = 80;
-            int y0 = (int)buffer_final.h / 2;     // needle origin (y)
-            int xr0 = (int)buffer_final.w - 80;
+            int r = lp->r;                  // needle radius
+            int x0 = lp->x0;                // needle origin (x)
+            int y0 = lp->y0;                // needle origin (y)
+            int xr0 = lp->xr0;
             int yr0 = y0;
 
-            // render the dial to the buffer
-            bf_clear(buffer_final);
-            bf_text(buffer_final, "DIN PPM", 7, 10, false, ax_l.screen_w/2 - 40, ax_l.screen_y + ax_l.screen_h - 80, 0, audio_c);
-            // dB scale markings
-            for (double dB = min_dB; dB < 0; dB += 5) {
-                bf_draw_ray(buffer_final, x0, y0, r+3, r+10, dB * m + c, 3, ax_c);
+            // render the dial to the buffer, unless the skin has it
+            draw_face(&dl, &sk);
+            if (!sk.face.pixels) {
+                tw_text(&texts, &dl, "DIN PPM", 7, lp->font_title, false, lp->title_x, lp->title_y, 0, audio_c);
+                // dB scale markings
+                for (double dB = min_dB; dB < 0; dB += 5) {
+                    dl_draw_ray(&dl, x0, y0, lp->tick_in, lp->tick_short, dB * m + c, lp->tick_w, ax_c);
+                }
+                for (double dB = min_dB; dB < 0; dB += 10) {
+                    dl_draw_ray(&dl, x0, y0, lp->tick_in, lp->tick_long, dB * m + c, lp->tick_w, ax_c);
+                }
+
+
+                for (double dB = min_dB; dB < 0; dB += 5) {
+                    dl_draw_ray(&dl, xr0, yr0, lp->tick_in, lp->tick_short, dB * m_r + c_r, lp->tick_w, ax_c);
+                }
+                for (double dB = min_dB; dB < 0; dB += 10) {
+                    dl_draw_ray(&dl, xr0, yr0, lp->tick_in, lp->tick_long, dB * m_r + c_r, lp->tick_w, ax_c);
+                }
+
+
+                // scale labels
+                int x, y;
+                bf_ray_xy(x0, y0, lp->label_r, -50 * m + c, &x, &y);
+                tw_text(&texts, &dl, "-50", 3, lp->font, false, x + lp->label_dx[0], y + lp->label_dy[0], 0, audio_c);
+                bf_ray_xy(x0, y0, lp->label_r, c, &x, &y);
+                tw_text(&texts, &dl, "0", 1, lp->font, false, x + lp->label_dx[1], y + lp->label_dy[1], 0, audio_c);
+                bf_ray_xy(x0, y0, lp->label_r, 5 * m + c, &x, &y);
+                tw_text(&texts, &dl, "+5", 2, lp->font, false, x + lp->label_dx[2], y + lp->label_dy[2], 0, ax2_c);
+                // dB excess
+                for (double dB = 0; dB <= max_dB; dB += 5) {
+                    dl_draw_ray(&dl, x0, y0, lp->excess_in, lp->tick_long, dB * m + c, lp->tick_w, ax2_c);
+                }
+
+
+                bf_ray_xy(xr0, yr0, lp->label_r, -50 * m_r + c_r, &x, &y);
+                tw_text(&texts, &dl, "-50", 3, lp->font, false, x + lp->label_dx[0], y + lp->label_dy[0], 0, audio_c);
+                bf_ray_xy(xr0, yr0, lp->label_r, c_r, &x, &y);
+                tw_text(&texts, &dl, "0", 1, lp->font, false, x + lp->label_dx[1], y + lp->label_dy[1], 0, audio_c);
+                bf_ray_xy(xr0, yr0, lp->label_r, 5 * m_r + c_r, &x, &y);
+                tw_text(&texts, &dl, "+5", 2, lp->font, false, x + lp->label_dx[2], y + lp->label_dy[2], 0, ax2_c);
+                // dB excess
+                for (double dB = 0; dB <= max_dB; dB += 5) {
+                    dl_draw_ray(&dl, xr0, yr0, lp->excess_in, lp->tick_long, dB * m_r + c_r, lp->tick_w, ax2_c);
+                }
+
+                // main dial
+                dl_draw_arc(&dl, x0, y0, r, min_dB * m + c, max_dB * m + c, lp->arc_w, ax_c);
+                dl_draw_arc(&dl, xr0, yr0, r, min_dB * m_r + c_r, max_dB * m_r + c_r, lp->arc_w, ax_c);
             }
-            for (double dB = min_dB; dB < 0; dB += 10) {
-                bf_draw_ray(buffer_final, x0, y0, r+3, r+22, dB * m + c, 3, ax_c);
-            }
-            
-
-            for (double dB = min_dB; dB < 0; dB += 5) {
-                bf_draw_ray(buffer_final, xr0, yr0, r+3, r+10, dB * m_r + c_r, 3, ax_c);
-            }
-            for (double dB = min_dB; dB < 0; dB += 10) {
-                bf_draw_ray(buffer_final, xr0, yr0, r+3, r+22, dB * m_r + c_r, 3, ax_c);
-            }
-
-
-            // scale labels
-            int x, y;
-            bf_ray_xy(x0, y0, r + 30, -50 * m + c, &x, &y);
-            bf_text(buffer_final, "-50", 3, 8, false, x-20, y-20, 0, audio_c);
-            bf_ray_xy(x0, y0, r + 30, c, &x, &y);
-            bf_text(buffer_final, "0", 1, 8, false, x + 3, y + 8, 0, audio_c);
-            bf_ray_xy(x0, y0, r + 30, 5 * m + c, &x, &y);
-            bf_text(buffer_final, "+5", 2, 8, false, x-10, y, 0, ax2_c);
-            // dB excess
-            for (double dB = 0; dB <= max_dB; dB += 5) {
-                bf_draw_ray(buffer_final, x0, y0, r+10, r+22, dB * m + c, 3, ax2_c);
-            }
-
-
-            bf_ray_xy(xr0, yr0, r + 30, -50 * m_r + c_r, &x, &y);
-            bf_text(buffer_final, "-50", 3, 8, false, x-20, y-20, 0, audio_c);
-            bf_ray_xy(xr0, yr0, r + 30, c_r, &x, &y);
-            bf_text(buffer_final, "0", 1, 8, false, x + 3, y + 8, 0, audio_c);
-            bf_ray_xy(xr0, yr0, r + 30, 5 * m_r + c_r, &x, &y);
-            bf_text(buffer_final, "+5", 2, 8, false, x-10, y, 0, ax2_c);
-            // dB excess
-            for (double dB = 0; dB <= max_dB; dB += 5) {
-                bf_draw_ray(buffer_final, xr0, yr0, r+10, r+22, dB * m_r + c_r, 3, ax2_c);
-            }
-
-            // main dial
-            bf_draw_arc(buffer_final, x0, y0, r, min_dB * m + c, max_dB * m + c, 2, ax_c);
-            bf_draw_arc(buffer_final, xr0, yr0, r, min_dB * m_r + c_r, max_dB * m_r + c_r, 2, ax_c);
 
             // dial excess; glow if hit
             if (ppm_l >= 0 || ppm_r >= 0 || clip) {
                 rgba excess_c = ax2_c;
                 excess_c.r = 255;
-                bf_draw_arc(buffer_final, x0, y0, r+10, c, max_dB * m + c, 6, excess_c);
-            } else {
-                bf_draw_arc(buffer_final, x0, y0, r+10, c, max_dB * m + c, 5, ax2_c);
+                dl_draw_arc(&dl, x0, y0, lp->excess_in, c, max_dB * m + c, lp->excess_glow_w, excess_c);
+            } else if (!sk.face.pixels) {
+                dl_draw_arc(&dl, x0, y0, lp->excess_in, c, max_dB * m + c, lp->excess_w, ax2_c);
             }
             // readings
-            bf_draw_ray(buffer_final, x0, y0, r - 160, r + 20, angle_l, 5, plot_l_c);
-            //bf_draw_ray(buffer_final, x0, y0, r - 100, r + 20, angle_r, 5, plot_r_c);
-            bf_draw_ray(buffer_final, xr0, yr0, r - 160, r + 20, angle_r, 5, plot_r_c);
+            draw_needle(&dl, &needle, lp, x0, y0, angle_l, plot_l_c);
+            draw_needle(&dl, &needle, lp, xr0, yr0, angle_r, plot_r_c);
             sprintf(textstr, "%+03.0fdB", ppm_l);
-            bf_text(buffer_final, textstr, 5, 8, false, ax_l.screen_x + 10, y0, 0, audio_c);
+            tw_text(&texts, &dl, textstr, 5, lp->font, false, lp->reading_l_x, y0, 0, audio_c);
             sprintf(textstr, "%+03.0fdB", ppm_r);
-            bf_text(buffer_final, textstr, 5, 8, false, ax_l.screen_w - 60, y0, 0, audio_c);
-            bf_text(buffer_final, "dB", 2, 16, true, 0, y0, 0, audio_c);
+            tw_text(&texts, &dl, textstr, 5, lp->font, false, lp->reading_r_x, y0, 0, audio_c);
+            tw_text(&texts, &dl, "dB", 2, lp->font_unit, true, 0, y0, 0, audio_c);
 
             // sampling rate
             sprintf(textstr, "%4.1fkHz", (double)audio.rate / 1000);
-            bf_text(buffer_final, textstr, 7, 10, false, ax_l.screen_w / 2 - 40, 80, 0, audio_c);
+            tw_text(&texts, &dl, textstr, 7, lp->font_title, false, lp->rate_x, lp->rate_y, 0, audio_c);
         }
         
 
         /* debugging info for the display
             sprintf(textstr, "%+7.2f peak_dB", peak_dB);
-            bf_text(buffer_final, textstr, 15, 8, false, ax_l.screen_x, ax_l.screen_y + ax_l.screen_h - 80, 0, audio_c);
+            dl_text(&dl, textstr, 15, 8, false, ax_l.screen_x, ax_l.screen_y + ax_l.screen_h - 80, 0, audio_c);
             sprintf(textstr, "%+7.2f noise_floor", p.noise_floor);
-            bf_text(buffer_final, textstr, 19, 8, false, ax_l.screen_x, ax_l.screen_y + ax_l.screen_h - 110, 0, audio_c);
+            dl_text(&dl, textstr, 19, 8, false, ax_l.screen_x, ax_l.screen_y + ax_l.screen_h - 110, 0, audio_c);
         end debugging info */
 
         // stuff common to all vis follows
-        fps = fps * 0.995 + (1.0 - 0.995) / dt;
-        sprintf(textstr, "%2.0f fps", fps);
-        
-        //bf_text(buffer_final, textstr, 6, 8, false, ax_l.screen_x + ax_l.screen_w - 60, ax_l.screen_y + ax_l.screen_h -80, 0, audio_c);
+        if (toggle_overlay) {
+            toggle_overlay = 0;
+            show_overlay = !show_overlay;
+        }
+        if (show_overlay) {
+            overlay_draw(&overlay, &dl, &texts, &lay.overlay, &pacer, &timing, &audio, text_c);
+        }
+
+        // draw the recorded frame; it is shown after the next wait
+        timing_stage(&timing, STAGE_RECORD);
+        rp_render(&pool, &dl, buffer_final);
+        timing_stage(&timing, STAGE_RENDER);
+        PROBE1(frame_end, frames);
+        metrics_publish(&metrics, ++frames, ffts, &pacer, &timing, &audio);
+        if (report_timing) {
+            report_timing = 0;
+            timing_report(&timing, stderr);
+            if (trace_dump(p.trace_file)) {
+                fprintf(stderr, "could not write the trace to %s\n", p.trace_file);
+            }
+        }
+        if (bench > 0) {
+            // on to the next vis once this one has had its share
+            struct timespec t;
+            clock_gettime(CLOCK_MONOTONIC, &t);
+            double s = t.tv_sec - bench_mark.tv_sec + (t.tv_nsec - bench_mark.tv_nsec) * 1e-9;
+            if (s >= bench / BENCH_VIS) {
+                printf("bench: %s, %" PRIu64 " frames in %.2f s, %.1f fps\n",
+                        p.vis, frames - bench_frames, s, (frames - bench_frames) / s);
+                timing_report(&timing, stdout);
+                if (++bench_mode == BENCH_VIS) {
+                    clean_exit = true;
+                } else {
+                    free(p.vis);
+                    p.vis = strdup(bench_vis[bench_mode]);
+                    timing_clear(&timing);
+                    bench_frames = frames;
+                    bench_mark = t;
+                }
+            }
+        }
 
 
 
@@ -622,7 +893,35 @@ All options are specified in config file, see in '/home/username/.config/spectru
 
     /*** exit ***/
 
-    // free screen buffers
+    if (bench > 0) {
+        // the whole process, input and render threads too
+        struct rusage ru;
+        struct timespec t;
+        getrusage(RUSAGE_SELF, &ru);
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        double s = t.tv_sec - bench_begin.tv_sec + (t.tv_nsec - bench_begin.tv_nsec) * 1e-9;
+        printf("bench: %" PRIu64 " frames in %.2f s, %.1f fps; cpu %.2f s user, %.2f s system; peak rss %.1f MB\n",
+                frames, s, frames / s,
+                ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6,
+                ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6, ru.ru_maxrss / 1024.0);
+    } else {
+        pacer_report(&pacer, stderr);
+        timing_report(&timing, stderr);
+    }
+    timing_free(&timing);
+    metrics_free(&metrics);
+
+    // stop the render threads, free screen buffers
+    rp_free(&pool);
+    dl_free(&dl);
+    nc_free(&needle);
+    skin_free(&sk);
+    tw_free(&texts);
+    free(scope_l);
+    free(scope_r);
+    if (blanked > 0) {
+        fb_blank(0);
+    }
     bf_free_pixels(&buffer_final);
     bf_free_pixels(&buffer_clock);
     fb_cleanup();
@@ -637,6 +936,8 @@ All options are specified in config file, see in '/home/username/.config/spectru
     // free fft working space
     fftw_free(audio.in_r);
     fftw_free(audio.in_l);
+    free(scope_in_l);
+    free(scope_in_r);
     fftw_free(audio.windowed_r);
     fftw_free(audio.windowed_l);
     fftw_free(audio.out_r);
@@ -0,0 +1,154 @@
+#include <string.h>
+
+#include "timing.h"
+#include "trace.h"
+
+#define TIMING_SMOOTH 0.1   // weight of a new sample in the recent times
+
+static const char *stage_names[STAGE_MAX] = {
+    "wait", "blit", "window", "fft", "bins", "smooth", "record", "render",
+};
+
+static uint64_t elapsed_ns(struct timespec t0, struct timespec t1) {
+    return (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000u + t1.tv_nsec - t0.tv_nsec;
+}
+
+static int bucket(uint64_t ns) {
+    // the first TIMING_SUB buckets are single nanoseconds, then each
+    // octave [2^e, 2^(e+1)) has TIMING_SUB of its own
+    if (ns < TIMING_SUB) {
+        return (int)ns;
+    }
+    int e = TIMING_SUB_BITS;
+    while (ns >> (e + 1)) {
+        e++;
+    }
+    int sub = (int)(ns >> (e - TIMING_SUB_BITS)) & (TIMING_SUB - 1);
+    int i = (e - TIMING_SUB_BITS + 1) * TIMING_SUB + sub;
+    return i < TIMING_BUCKETS ? i : TIMING_BUCKETS - 1;
+}
+
+static double bucket_width(int i) {
+    return i < TIMING_SUB ? 1 : (double)((uint64_t)1 << (i / TIMING_SUB - 1));
+}
+
+static double bucket_start(int i) {
+    return i < TIMING_SUB ? i : (TIMING_SUB + i % TIMING_SUB) * bucket_width(i);
+}
+
+static double bucket_ns(int i) {
+    // the middle of bucket i
+    return i < TIMING_SUB ? i : bucket_start(i) + bucket_width(i) / 2;
+}
+
+static double percentile(const histogram *h, double q) {
+    uint64_t rank = (uint64_t)(q * (h->n - 1)) + 1, seen = 0;
+    for (int i = 0; i < TIMING_BUCKETS; i++) {
+        seen += h->count[i];
+        if (seen >= rank) {
+            return bucket_ns(i) < h->max ? bucket_ns(i) : h->max;
+        }
+    }
+    return h->max;
+}
+
+uint64_t timing_count_le(const histogram *h, double s) {
+    // times in buckets that end at or below s seconds
+    uint64_t n = 0;
+    for (int i = 0; i < TIMING_BUCKETS && (bucket_start(i) + bucket_width(i)) * 1e-9 <= s; i++) {
+        n += h->count[i];
+    }
+    return n;
+}
+
+void timing_init(timing *t) {
+    memset(t, 0, sizeof(*t));
+    timing_start(t);
+}
+
+int timing_counters(timing *t) {
+    t->counting = counters_open(&t->hw) > 0;
+    return t->counting;
+}
+
+void timing_free(timing *t) {
+    if (t->counting) {
+        counters_close(&t->hw);
+        t->counting = 0;
+    }
+}
+
+void timing_clear(timing *t) {
+    memset(t->h, 0, sizeof(t->h));
+    memset(t->recent, 0, sizeof(t->recent));
+    memset(t->hw_sum, 0, sizeof(t->hw_sum));
+    timing_start(t);
+}
+
+void timing_start(timing *t) {
+    clock_gettime(CLOCK_MONOTONIC, &t->mark);
+    if (t->counting) {
+        counters_read(&t->hw, t->hw_mark);
+    }
+}
+
+void timing_stage(timing *t, enum stage s) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ns = elapsed_ns(t->mark, now);
+    trace_span(stage_names[s], t->mark, now);
+    histogram *h = &t->h[s];
+    h->count[bucket(ns)]++;
+    h->n++;
+    h->sum += ns;
+    h->max = ns > h->max ? ns : h->max;
+    t->recent[s] += TIMING_SMOOTH * (ns * 1e-9 - t->recent[s]);
+    t->mark = now;
+
+    uint64_t v[COUNTER_MAX];
+    if (t->counting && !counters_read(&t->hw, v)) {
+        for (int k = 0; k < COUNTER_MAX; k++) {
+            t->hw_sum[s][k] += v[k] - t->hw_mark[k];
+            t->hw_mark[k] = v[k];
+        }
+    }
+}
+
+static void report_counters(const timing *t, FILE *f) {
+    // per frame, and instructions per cycle
+    fprintf(f, "counters: %-7s %12s %12s %6s %12s %13s\n",
+            "stage", "cycles", "instructions", "IPC", "cache-misses", "branch-misses");
+    for (int s = 0; s < STAGE_MAX; s++) {
+        const uint64_t *sum = t->hw_sum[s];
+        double n = t->h[s].n;
+        if (!n) {
+            continue;
+        }
+        fprintf(f, "counters: %-7s %12.0f %12.0f %6.2f %12.0f %13.0f\n", stage_names[s],
+                sum[COUNTER_CYCLES] / n, sum[COUNTER_INSTRUCTIONS] / n,
+                sum[COUNTER_CYCLES] ? (double)sum[COUNTER_INSTRUCTIONS] / sum[COUNTER_CYCLES] : 0,
+                sum[COUNTER_CACHE_MISSES] / n, sum[COUNTER_BRANCH_MISSES] / n);
+    }
+}
+
+void timing_report(const timing *t, FILE *f) {
+    fprintf(f, "timing: %-7s %8s %9s %9s %9s %9s %9s %9s\n",
+            "stage", "frames", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for (int s = 0; s < STAGE_MAX; s++) {
+        const histogram *h = &t->h[s];
+        if (!h->n) {
+            continue;
+        }
+        fprintf(f, "timing: %-7s %8" PRIu64 " %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f ms\n",
+                stage_names[s], h->n, h->sum * 1e-6 / h->n,
+                percentile(h, 0.5) * 1e-6, percentile(h, 0.9) * 1e-6,
+                percentile(h, 0.99) * 1e-6, percentile(h, 0.999) * 1e-6, h->max * 1e-6);
+    }
+    if (t->counting) {
+        report_counters(t, f);
+    }
+}
+
+const char *timing_stage_name(enum stage s) {
+    return stage_names[s];
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "counters.h"
+
+// Frame stage timing.
+// Each stage of a frame is timed on CLOCK_MONOTONIC, from the end of
+// the stage before, into a histogram of its own. Buckets are log-linear:
+// an octave of nanoseconds is split into TIMING_SUB equal parts, so a
+// percentile is good to 1/TIMING_SUB of its value in a fixed, small
+// table however long the program runs.
+// With timing_counters the hardware counters of the timing thread are
+// summed per stage as well.
+
+#define TIMING_SUB_BITS 4
+#define TIMING_SUB (1 << TIMING_SUB_BITS)
+#define TIMING_BUCKETS (TIMING_SUB * 34)    // up to 2^37 ns, over two minutes
+
+enum stage {
+    STAGE_WAIT,     // for the frame's deadline or vsync
+    STAGE_BLIT,     // the last frame to the screen
+    STAGE_WINDOW,
+    STAGE_FFT,
+    STAGE_BINS,
+    STAGE_SMOOTH,
+    STAGE_RECORD,   // the rest of the vis, into the display list
+    STAGE_RENDER,   // the display list, into the buffer
+    STAGE_MAX,
+};
+
+typedef struct {
+    uint32_t count[TIMING_BUCKETS];
+    uint64_t n;
+    uint64_t sum;   // ns
+    uint64_t max;
+} histogram;
+
+typedef struct {
+    histogram h[STAGE_MAX];
+    double recent[STAGE_MAX];   // s, smoothed over the last few frames
+    struct timespec mark;       // end of the last stage timed
+    int counting;               // hw is open
+    counters hw;
+    uint64_t hw_mark[COUNTER_MAX];
+    uint64_t hw_sum[STAGE_MAX][COUNTER_MAX];
+} timing;
+
+void timing_init(timing *t);
+
+// Count cycles, instructions and misses per stage too, on the calling
+// thread. Returns 0 if no counter could be opened.
+int timing_counters(timing *t);
+
+void timing_free(timing *t);
+
+// Forget the times so far, and the counts; the counters stay open.
+void timing_clear(timing *t);
+
+// Start timing stages from now.
+void timing_start(timing *t);
+
+// The stage that ends now, begun when the last one ended.
+void timing_stage(timing *t, enum stage s);
+
+void timing_report(const timing *t, FILE *f);
+
+// Times in h no longer than s seconds, to within a bucket.
+uint64_t timing_count_le(const histogram *h, double s);
+
+const char *timing_stage_name(enum stage s);
@@ -0,0 +1,152 @@
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+typedef struct {
+    const char *name;
+    uint64_t ts, dur;   // ns
+    char phase;         // as in the trace format: B, E, X or i
+} event;
+
+typedef struct {
+    const char *name;
+    uint32_t head;      // events ever recorded; published with release
+    event events[TRACE_EVENTS];
+} ring;
+
+// rings are claimed, never given back, and only freed at exit
+static ring *rings[TRACE_THREADS];
+static uint32_t claimed;
+static __thread ring *mine;
+
+static uint64_t ns(struct timespec t) {
+    return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+static ring *own_ring(void) {
+    if (mine) {
+        return mine;
+    }
+    uint32_t i = __atomic_fetch_add(&claimed, 1, __ATOMIC_RELAXED);
+    if (i >= TRACE_THREADS) {
+        return NULL;
+    }
+    ring *r = calloc(1, sizeof(ring));
+    if (!r) {
+        return NULL;
+    }
+    r->name = "thread";
+    __atomic_store_n(&rings[i], r, __ATOMIC_RELEASE);
+    mine = r;
+    return r;
+}
+
+static void record(const char *name, char phase, uint64_t ts, uint64_t dur) {
+    ring *r = own_ring();
+    if (!r) {
+        return;
+    }
+    // the slot is only read once head has passed it
+    uint32_t head = r->head;
+    event *e = &r->events[head & (TRACE_EVENTS - 1)];
+    e->name = name;
+    e->phase = phase;
+    e->ts = ts;
+    e->dur = dur;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static uint64_t now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ns(t);
+}
+
+void trace_thread(const char *name) {
+    ring *r = own_ring();
+    if (r) {
+        r->name = name;
+    }
+}
+
+void trace_begin(const char *name) {
+    record(name, 'B', now(), 0);
+}
+
+void trace_end(const char *name) {
+    record(name, 'E', now(), 0);
+}
+
+void trace_instant(const char *name) {
+    record(name, 'i', now(), 0);
+}
+
+void trace_span(const char *name, struct timespec begin, struct timespec end) {
+    record(name, 'X', ns(begin), ns(end) - ns(begin));
+}
+
+static void dump_ring(FILE *f, ring *r, int tid, event *copy, int *first) {
+    // Copy the ring while its thread goes on recording, then keep only
+    // the events it cannot have overwritten meanwhile. Event k goes over
+    // event k - TRACE_EVENTS, and the one at the head read afterwards
+    // may be half written.
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint32_t n = head < TRACE_EVENTS ? head : TRACE_EVENTS;
+    for (uint32_t i = head - n; i != head; i++) {
+        copy[i & (TRACE_EVENTS - 1)] = r->events[i & (TRACE_EVENTS - 1)];
+    }
+    uint32_t after = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    int64_t lost = (int64_t)(uint32_t)(after - head) + 1 + n - TRACE_EVENTS;
+    uint32_t from = head - n + (uint32_t)(lost < 0 ? 0 : lost < n ? lost : n);
+
+    fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            *first ? "" : ",\n", tid, r->name);
+    *first = 0;
+    for (uint32_t i = from; i != head; i++) {
+        const event *e = &copy[i & (TRACE_EVENTS - 1)];
+        fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+                e->name, e->phase, tid, e->ts * 1e-3);
+        if (e->phase == 'X') {
+            fprintf(f, ",\"dur\":%.3f", e->dur * 1e-3);
+        } else if (e->phase == 'i') {
+            fprintf(f, ",\"s\":\"t\"");
+        }
+        fputc('}', f);
+    }
+}
+
+int trace_dump(const char *path) {
+    // written aside and renamed, so a reader never sees half a file
+    char tmp[PATH_MAX + 8];
+    event *copy = malloc(sizeof(event) * TRACE_EVENTS);
+    if (!copy) {
+        return -1;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        free(copy);
+        return -1;
+    }
+    int first = 1;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (int i = 0; i < TRACE_THREADS; i++) {
+        ring *r = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+        if (r) {
+            dump_ring(f, r, i + 1, copy, &first);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    free(copy);
+    int err = fclose(f) != 0;
+    if (err || rename(tmp, path)) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
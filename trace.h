@@ -0,0 +1,41 @@
+#pragma once
+
+#include <time.h>
+
+// Event tracing, in builds configured with --enable-trace.
+// Each thread records what it does, as spans and instants on
+// CLOCK_MONOTONIC, into a ring of its own that only it writes, so
+// recording takes no lock and never waits on the thread dumping.
+// trace_dump writes the last TRACE_EVENTS of every thread as a Chrome
+// trace, for chrome://tracing or ui.perfetto.dev. Event names are kept
+// by pointer and must outlive the trace, as string literals do.
+// Without TRACE defined every call compiles to nothing.
+
+#ifdef TRACE
+
+#define TRACE_THREADS 16
+#define TRACE_EVENTS 65536  // per thread, a power of two
+
+// Names the calling thread in the trace; a thread that records without
+// calling this first is named "thread".
+void trace_thread(const char *name);
+
+void trace_begin(const char *name);
+void trace_end(const char *name);
+void trace_instant(const char *name);
+// A span already timed.
+void trace_span(const char *name, struct timespec begin, struct timespec end);
+
+// Returns 0 if the trace was written to path.
+int trace_dump(const char *path);
+
+#else
+
+#define trace_thread(name) ((void)0)
+#define trace_begin(name) ((void)0)
+#define trace_end(name) ((void)0)
+#define trace_instant(name) ((void)0)
+#define trace_span(name, begin, end) ((void)0)
+#define trace_dump(path) 0
+
+#endif